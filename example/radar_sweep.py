@@ -185,15 +185,19 @@ def main():
 
     print("Compiling callbacks.")
 
-    project = Map(wrap_projection(lightness).address, 3, 1)
-
-    swap_all = Map(wrap_mixer(swap_channels([0, 1, 2])).address, 6, 6)
-    swap_r = Map(wrap_mixer(swap_channels([2])).address, 6, 6)
-    swap_rg = Map(wrap_mixer(swap_channels([1, 2])).address, 6, 6)
-    swap_g = Map(wrap_mixer(swap_channels([1])).address, 6, 6)
-    swap_gb = Map(wrap_mixer(swap_channels([0, 1])).address, 6, 6)
-    swap_b = Map(wrap_mixer(swap_channels([0])).address, 6, 6)
-    swap_br = Map(wrap_mixer(swap_channels([0, 2])).address, 6, 6)
+    # native equivalents of:
+    #   Map(wrap_projection(lightness).address, 3, 1)
+    #   Map(wrap_mixer(swap_channels([...])).address, 6, 6)
+    # (images are loaded by OpenCV in BGR order)
+    project = Map.lightness() << Map.select([2, 1, 0], 3)
+
+    swap_all = Map.swap([0, 1, 2], 3)
+    swap_r = Map.swap([2], 3)
+    swap_rg = Map.swap([1, 2], 3)
+    swap_g = Map.swap([1], 3)
+    swap_gb = Map.swap([0, 1], 3)
+    swap_b = Map.swap([0], 3)
+    swap_br = Map.swap([0, 2], 3)
 
     # mixers = [swap_all, swap_rg, swap_all, swap_gb, swap_all, swap_br]
     mixers = [swap_all, swap_r, swap_all, swap_g, swap_all, swap_b]
@@ -252,11 +256,18 @@ def main():
         topology = ImageTopology.Torus
         traversal = SegmentTraversal.Forward
 
+        # project every pixel once per frame, rather than once per annulus
+        # (annuli are disjoint, so sorting one does not invalidate the keys
+        # of another)
+        frame_keys = frame.project(project)
+
         def sort_segment(i):
             s = Segment(frame_annuli[i])
             seg_px = s.get_pixels(frame, traversal, None, topology)
             skew_px = s.get_pixels(frame, traversal, frame_skew, topology)
-            sorted_seg_px = sorters[i](seg_px, skew_px)
+            skew_keys = s.get_pixels(frame_keys, traversal, frame_skew,
+                                     topology)
+            sorted_seg_px = sorters[i](seg_px, skew_px, skew_keys)
             # this line mutates the frame
             s.put_pixels(frame, SegmentTraversal.Forward,
                          sorted_seg_px, topology)
@@ -1,5 +1,7 @@
 #include <cassert>
+#include <stdexcept>
 #include "Image.h"
+#include "Map.h"
 
 using namespace pxsort;
 
@@ -38,3 +40,17 @@ float Image::at(int32_t x, int32_t y, int32_t cn) const {
 const float *Image::ptr(int32_t x, int32_t y) const {
     return ((Image *) this)->ptr(x, y);
 }
+
+Image Image::project(const Map &projection) const {
+    if (projection.inDim != depth || projection.outDim != 1)
+        throw std::invalid_argument(
+                "pxsort::Image: projection must map R^depth to R.");
+
+    const auto compiled = projection.compile();
+    Image keys(width, height, 1);
+    #pragma omp parallel for default(none) shared(compiled, keys)
+    for (int32_t y = 0; y < height; y++)
+        compiled(ptr(0, y), depth, keys.ptr(0, y), 1, width);
+
+    return keys;
+}
@@ -94,6 +94,22 @@ public:
     [[nodiscard]]
     float at(int32_t x, int32_t y, int32_t cn) const;
 
+    /**
+     * Evaluates a projection over every pixel of this Image.
+     * Rows of pixels are projected in parallel, in batches.
+     * The result can be read with a Segment like any other Image, and passed
+     * to a Sorter as precomputed keys, so that an Image whose Segments
+     * overlap (or that is sorted by several Sorters with the same projection)
+     * only needs to be projected once.
+     * @param projection A Map from R^depth to R.
+     * @throws std::invalid_argument If projection's dimensions do not match.
+     * @return A new Image with the same width and height as this one, and
+     *   depth 1, whose pixel (x, y) is the projection of this Image's pixel
+     *   (x, y).
+     */
+    [[nodiscard]]
+    Image project(const Map &projection) const;
+
 private:
     int32_t row_stride;
 
@@ -1,13 +1,39 @@
 #include "Map.h"
+#include "PixelKernels.h"
 #include "util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <numeric>
+#include <vector>
 
 using namespace pxsort;
 
+/**
+ * Maximum number of inputs that a composite MapImpl evaluates at once when
+ * invoked on a batch. Bounds the size of the intermediate buffers that
+ * composite MapImpls allocate on the stack.
+ */
+constexpr int32_t MAX_CHUNK = 256;
 
-class Map::MapImpl {
+/**
+ * Indices of the registers holding each element of a vector-valued
+ * intermediate result in a Tape.
+ */
+using Registers = std::vector<int32_t>;
+
+struct Tape;
+
+
+class Map::MapImpl : public std::enable_shared_from_this<Map::MapImpl> {
 public:
     const uint32_t in_dim;
     const uint32_t out_dim;
@@ -18,9 +44,211 @@ public:
     virtual
     void operator()(const float *in, float *out) const = 0;
 
+    /**
+     * Evaluates this MapImpl on a batch of n strided inputs.
+     * The default implementation invokes the single-input overload once per
+     * input; subclasses should override this to amortize dispatch.
+     */
+    virtual
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const {
+        for (int32_t k = 0; k < n; k++)
+            (*this)(&in[k * inStride], &out[k * outStride]);
+    }
+
+    /**
+     * Appends the instructions needed to evaluate this MapImpl to the given
+     * Tape.
+     * The default implementation emits a single instruction that invokes this
+     * MapImpl directly; composite MapImpls override this to lower their
+     * children onto the tape instead.
+     * @param tape The Tape to append instructions to.
+     * @param in The registers holding this MapImpl's input.
+     * @return The registers holding this MapImpl's output.
+     */
+    virtual
+    Registers lower(Tape &tape, const Registers &in) const;
+
+    /**
+     * Returns a MapImpl that computes only the ith output of this MapImpl.
+     * The default implementation evaluates this MapImpl and discards all
+     * other outputs; composite MapImpls override this to avoid evaluating
+     * children that do not contribute to the ith output.
+     * @param i An integer in the range [0, ..., out_dim - 1].
+     */
+    virtual
+    std::shared_ptr<MapImpl> project(int i);
+
+    /**
+     * A short, human-readable description of this MapImpl, used to label
+     * nodes in profiling reports.
+     */
+    [[nodiscard]]
+    virtual std::string name() const = 0;
+
+    /**
+     * Returns the MapImpls that this MapImpl is composed of (if any).
+     */
+    [[nodiscard]]
+    virtual std::vector<std::shared_ptr<MapImpl>> children() const {
+        return {};
+    }
+
+    /**
+     * Returns a copy of this MapImpl with its children replaced by the given
+     * MapImpls, which must have the same dimensions as (and be given in the
+     * same order as) the MapImpls returned by children().
+     * The default implementation (for MapImpls without children) returns this
+     * MapImpl.
+     */
+    virtual
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &) {
+        return shared_from_this();
+    }
+
     virtual ~MapImpl() = default;
 };
 
+/**
+ * A flat, linear program that evaluates a tree of MapImpls.
+ *
+ * All intermediate results live in a single register file; registers
+ * [0, in_dim) hold the program's input.
+ * Each instruction either invokes a (non-composite) MapImpl on a contiguous
+ * run of registers, or gathers scattered registers into a contiguous run.
+ */
+struct Tape {
+    struct Instruction {
+        /** The MapImpl to invoke, or nullptr for a gather instruction. */
+        std::shared_ptr<const Map::MapImpl> impl;
+        /** First input register (unused by gather instructions). */
+        int32_t in;
+        /** First output register. */
+        int32_t out;
+        /** Source registers of a gather instruction. */
+        Registers gather;
+    };
+
+    std::vector<Instruction> instructions;
+    int32_t nRegisters = 0;
+    Registers outputs;
+
+    /**
+     * The registers holding the output of each (MapImpl, input registers)
+     * pair lowered so far.
+     */
+    std::map<std::pair<const Map::MapImpl *, Registers>, Registers> lowered;
+
+    /**
+     * Reserves n new contiguous registers.
+     * @return The first reserved register.
+     */
+    int32_t allocate(int32_t n) {
+        auto first = nRegisters;
+        nRegisters += n;
+        return first;
+    }
+
+    /**
+     * Returns the first of a contiguous run of registers holding the values
+     * in the given registers, emitting a gather instruction if the given
+     * registers are not already contiguous.
+     */
+    int32_t contiguous(const Registers &regs) {
+        bool isContiguous = true;
+        for (int32_t j = 1; j < static_cast<int32_t>(regs.size()); j++)
+            isContiguous &= regs[j] == regs[0] + j;
+        if (isContiguous)
+            return regs.empty() ? 0 : regs[0];
+
+        auto out = allocate(static_cast<int32_t>(regs.size()));
+        instructions.push_back({nullptr, 0, out, regs});
+        return out;
+    }
+
+    /**
+     * Appends the instructions needed to evaluate impl on the given
+     * registers to this Tape, unless they have already been appended (i.e.
+     * impl is shared by several parts of the tree being lowered), in which
+     * case the registers holding the earlier result are reused.
+     * Composite MapImpls lower their children via this method, so that
+     * shared sub-maps are evaluated once per input.
+     * @return The registers holding impl's output.
+     */
+    Registers lower(const Map::MapImpl &impl, const Registers &in) {
+        auto key = std::make_pair(&impl, in);
+        auto it = lowered.find(key);
+        if (it != lowered.end())
+            return it->second;
+
+        auto out = impl.lower(*this, in);
+        lowered.emplace(std::move(key), out);
+        return out;
+    }
+
+    /**
+     * Removes instructions whose outputs never (transitively) contribute to
+     * this Tape's outputs.
+     */
+    void eliminateDeadInstructions() {
+        std::vector<bool> live(nRegisters, false);
+        for (auto r: outputs)
+            live[r] = true;
+
+        std::vector<Instruction> kept;
+        for (auto it = instructions.rbegin(); it != instructions.rend(); it++) {
+            auto outSize = it->impl ? it->impl->out_dim : it->gather.size();
+            bool isLive = false;
+            for (size_t j = 0; j < outSize; j++)
+                isLive |= live[it->out + j];
+            if (!isLive)
+                continue;
+
+            if (it->impl)
+                for (uint32_t j = 0; j < it->impl->in_dim; j++)
+                    live[it->in + j] = true;
+            else
+                for (auto r: it->gather)
+                    live[r] = true;
+            kept.push_back(std::move(*it));
+        }
+
+        instructions.assign(std::make_move_iterator(kept.rbegin()),
+                            std::make_move_iterator(kept.rend()));
+    }
+
+    /**
+     * Evaluates this Tape on a batch of n inputs.
+     * @param regs A register file with n rows of nRegisters floats, whose
+     * input registers have been initialized.
+     */
+    void run(float *regs, int32_t n) const {
+        for (auto &inst: instructions) {
+            if (inst.impl) {
+                inst.impl->batch(&regs[inst.in], nRegisters,
+                                 &regs[inst.out], nRegisters, n);
+                continue;
+            }
+            for (int32_t k = 0; k < n; k++) {
+                float *row = &regs[k * nRegisters];
+                for (size_t j = 0; j < inst.gather.size(); j++)
+                    row[inst.out + j] = row[inst.gather[j]];
+            }
+        }
+    }
+};
+
+Registers Map::MapImpl::lower(Tape &tape, const Registers &in) const {
+    auto first = tape.contiguous(in);
+    auto out = tape.allocate(static_cast<int32_t>(out_dim));
+    tape.instructions.push_back({shared_from_this(), first, out, {}});
+
+    Registers outRegs(out_dim);
+    std::iota(outRegs.begin(), outRegs.end(), out);
+    return outRegs;
+}
+
 class FuncPtrImpl : public Map::MapImpl {
     Map::fp_t fp;
 
@@ -36,6 +264,88 @@ public:
     void operator()(const float *in, float *out) const override {
         fp(in, in_dim, out, out_dim);
     }
+
+    [[nodiscard]]
+    std::string name() const override {
+        std::ostringstream os;
+        os << "function(" << reinterpret_cast<void *>(fp) << ")";
+        return os.str();
+    }
+};
+
+class ParamFuncPtrImpl : public Map::MapImpl {
+    Map::param_fp_t fp;
+    std::vector<float> params;
+
+public:
+    ParamFuncPtrImpl() = delete;
+
+    ParamFuncPtrImpl(Map::param_fp_t fp, uint32_t in_dim, uint32_t out_dim,
+                     std::vector<float> params)
+        : Map::MapImpl(in_dim, out_dim), fp(fp), params(std::move(params)) {}
+
+    ~ParamFuncPtrImpl() override = default;
+
+    inline
+    void operator()(const float *in, float *out) const override {
+        fp(in, in_dim, out, out_dim,
+           params.data(), static_cast<int32_t>(params.size()));
+    }
+
+    [[nodiscard]]
+    const std::vector<float> &getParams() const {
+        return params;
+    }
+
+    /**
+     * Overwrites this MapImpl's parameters in place.
+     * The number of parameters is fixed, so the parameter buffer passed to
+     * fp never moves.
+     */
+    void setParams(const std::vector<float> &p) {
+        if (p.size() != params.size())
+            throw std::invalid_argument(
+                    "pxsort::Map: wrong number of parameters.");
+        std::copy(p.begin(), p.end(), params.begin());
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        std::ostringstream os;
+        os << "function(" << reinterpret_cast<void *>(fp) << ", "
+           << params.size() << " params)";
+        return os.str();
+    }
+};
+
+class BatchFuncPtrImpl : public Map::MapImpl {
+    Map::batch_fp_t fp;
+
+public:
+    BatchFuncPtrImpl() = delete;
+
+    BatchFuncPtrImpl(Map::batch_fp_t fp, uint32_t in_dim, uint32_t out_dim)
+        : Map::MapImpl(in_dim, out_dim), fp(fp) {}
+
+    ~BatchFuncPtrImpl() override = default;
+
+    inline
+    void operator()(const float *in, float *out) const override {
+        fp(in, in_dim, in_dim, out, out_dim, out_dim, 1);
+    }
+
+    inline
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        fp(in, in_dim, inStride, out, out_dim, outStride, n);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        std::ostringstream os;
+        os << "batch_function(" << reinterpret_cast<void *>(fp) << ")";
+        return os.str();
+    }
 };
 
 class FuncObjImpl : public Map::MapImpl {
@@ -53,6 +363,61 @@ public:
     void operator()(const float *in, float *out) const override {
         fn(in, in_dim, out, out_dim);
     }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "function_object";
+    }
+};
+
+/**
+ * Selects (and possibly repeats or reorders) elements of its input.
+ */
+class SelectImpl : public Map::MapImpl {
+    std::vector<int32_t> indices;
+
+public:
+    SelectImpl() = delete;
+
+    ~SelectImpl() override = default;
+
+    SelectImpl(uint32_t in_dim, std::vector<int32_t> indices)
+        : Map::MapImpl(in_dim, indices.size()), indices(std::move(indices)) {}
+
+private:
+    void operator()(const float *in, float *out) const override {
+        for (uint32_t j = 0; j < out_dim; j++)
+            out[j] = in[indices[j]];
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        for (int32_t k = 0; k < n; k++)
+            for (uint32_t j = 0; j < out_dim; j++)
+                out[k * outStride + j] = in[k * inStride + indices[j]];
+    }
+
+    Registers lower(Tape &, const Registers &in) const override {
+        Registers out(out_dim);
+        for (uint32_t j = 0; j < out_dim; j++)
+            out[j] = in[indices[j]];
+        return out;
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        return std::make_shared<SelectImpl>(in_dim,
+                                            std::vector<int32_t>{indices[i]});
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        std::ostringstream os;
+        os << "select(";
+        for (uint32_t j = 0; j < out_dim; j++)
+            os << (j > 0 ? ", " : "") << indices[j];
+        os << ")";
+        return os.str();
+    }
 };
 
 class CompositionImpl : public Map::MapImpl {
@@ -65,7 +430,7 @@ public:
     ~CompositionImpl() override = default;
 
     CompositionImpl(std::shared_ptr<MapImpl> f, std::shared_ptr<MapImpl> g)
-        : Map::MapImpl(g->in_dim, g->out_dim),
+        : Map::MapImpl(g->in_dim, f->out_dim),
           f(std::move(f)), g(std::move(g)) {}
 
 private:
@@ -75,6 +440,39 @@ private:
         (*g)(in, g_out);
         (*f)(g_out, out);
     }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        float g_out[min(n, MAX_CHUNK) * g->out_dim];
+        for (int32_t k = 0; k < n; k += MAX_CHUNK) {
+            auto chunk = min(n - k, MAX_CHUNK);
+            g->batch(&in[k * inStride], inStride, g_out, g->out_dim, chunk);
+            f->batch(g_out, g->out_dim, &out[k * outStride], outStride, chunk);
+        }
+    }
+
+    Registers lower(Tape &tape, const Registers &in) const override {
+        return tape.lower(*f, tape.lower(*g, in));
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        return std::make_shared<CompositionImpl>(f->project(i), g);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "composition";
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return {f, g};
+    }
+
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &c) override {
+        return std::make_shared<CompositionImpl>(c[0], c[1]);
+    }
 };
 
 class ConcatenationImpl : public Map::MapImpl {
@@ -109,6 +507,60 @@ private:
             out_idx += impl->out_dim;
         }
     }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        int in_idx = 0;
+        int out_idx = 0;
+        for (auto &impl: impls){
+            impl->batch(&in[in_idx], inStride, &out[out_idx], outStride, n);
+            in_idx += impl->in_dim;
+            out_idx += impl->out_dim;
+        }
+    }
+
+    Registers lower(Tape &tape, const Registers &in) const override {
+        Registers out;
+        auto in_it = in.begin();
+        for (auto &impl: impls) {
+            Registers impl_in(in_it, in_it + impl->in_dim);
+            auto impl_out = tape.lower(*impl, impl_in);
+            out.insert(out.end(), impl_out.begin(), impl_out.end());
+            in_it += impl->in_dim;
+        }
+        return out;
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        int in_idx = 0;
+        for (auto &impl: impls) {
+            if (i < static_cast<int>(impl->out_dim)) {
+                std::vector<int32_t> slice(impl->in_dim);
+                std::iota(slice.begin(), slice.end(), in_idx);
+                return std::make_shared<CompositionImpl>(
+                        impl->project(i),
+                        std::make_shared<SelectImpl>(in_dim, slice));
+            }
+            i -= static_cast<int>(impl->out_dim);
+            in_idx += static_cast<int>(impl->in_dim);
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "concatenation";
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return impls;
+    }
+
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &c) override {
+        return std::make_shared<ConcatenationImpl>(c);
+    }
 };
 
 class ForkImpl : public Map::MapImpl {
@@ -128,6 +580,39 @@ private:
         (*f)(in, out);
         (*g)(in, &out[f->out_dim]);
     }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        f->batch(in, inStride, out, outStride, n);
+        g->batch(in, inStride, &out[f->out_dim], outStride, n);
+    }
+
+    Registers lower(Tape &tape, const Registers &in) const override {
+        auto out = tape.lower(*f, in);
+        auto g_out = tape.lower(*g, in);
+        out.insert(out.end(), g_out.begin(), g_out.end());
+        return out;
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        const auto fDim = static_cast<int>(f->out_dim);
+        return i < fDim ? f->project(i) : g->project(i - fDim);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "fork";
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return {f, g};
+    }
+
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &c) override {
+        return std::make_shared<ForkImpl>(c[0], c[1]);
+    }
 };
 
 class ProjectionImpl : public Map::MapImpl {
@@ -148,8 +633,45 @@ private:
         (*f)(in, f_out);
         out[0] = f_out[i];
     }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        float f_out[min(n, MAX_CHUNK) * f->out_dim];
+        for (int32_t k = 0; k < n; k += MAX_CHUNK) {
+            auto chunk = min(n - k, MAX_CHUNK);
+            f->batch(&in[k * inStride], inStride, f_out, f->out_dim, chunk);
+            for (int32_t j = 0; j < chunk; j++)
+                out[(k + j) * outStride] = f_out[j * f->out_dim + i];
+        }
+    }
+
+    Registers lower(Tape &tape, const Registers &in) const override {
+        return {tape.lower(*f, in)[i]};
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "projection[" + std::to_string(i) + "]";
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return {f};
+    }
+
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &c) override {
+        return std::make_shared<ProjectionImpl>(c[0], i);
+    }
 };
 
+std::shared_ptr<Map::MapImpl> Map::MapImpl::project(int i) {
+    if (out_dim == 1)
+        return shared_from_this();
+
+    return std::make_shared<ProjectionImpl>(shared_from_this(), i);
+}
+
 class ConstantImpl : public Map::MapImpl {
     std::vector<float> values;
 
@@ -167,6 +689,474 @@ private:
             out[i] = values[i];
         }
     }
+
+    void batch(const float *, int32_t,
+               float *out, int32_t outStride, int32_t n) const override {
+        for (int32_t k = 0; k < n; k++)
+            std::copy(values.begin(), values.end(), &out[k * outStride]);
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        return std::make_shared<ConstantImpl>(std::vector<float>{values[i]},
+                                              in_dim);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "constant";
+    }
+};
+
+class WeightedSumImpl : public Map::MapImpl {
+    std::vector<float> weights;
+
+public:
+    WeightedSumImpl() = delete;
+
+    ~WeightedSumImpl() override = default;
+
+    explicit WeightedSumImpl(std::vector<float> weights)
+        : Map::MapImpl(weights.size(), 1), weights(std::move(weights)) {}
+
+private:
+    void operator()(const float *in, float *out) const override {
+        float sum = 0;
+        for (uint32_t j = 0; j < in_dim; j++)
+            sum += weights[j] * in[j];
+        out[0] = sum;
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        kernels::weightedSum(weights.data(), in_dim, in, inStride,
+                             out, outStride, n);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "weighted_sum";
+    }
+};
+
+/**
+ * A native MapImpl from [0, 1]^3 to [0, 1] that computes a projection of an
+ * RGB pixel.
+ */
+template <kernels::RGBProjection p>
+class RGBProjectionImpl : public Map::MapImpl {
+public:
+    RGBProjectionImpl() : Map::MapImpl(3, 1) {}
+
+    ~RGBProjectionImpl() override = default;
+
+private:
+    void operator()(const float *in, float *out) const override {
+        out[0] = kernels::project<p>(in[0], in[1], in[2]);
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        kernels::project(p, in, inStride, out, outStride, n);
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        switch (p) {
+            case kernels::LIGHTNESS: return "lightness";
+            case kernels::VALUE: return "value";
+            case kernels::HUE: return "hue";
+            case kernels::HSV_SATURATION: return "hsv_saturation";
+            case kernels::HSL_SATURATION: return "hsl_saturation";
+        }
+        return "rgb_projection";
+    }
+};
+
+template <Map::Blend mode>
+inline float blendChannel(float a, float b) {
+    switch (mode) {
+        case Map::MIN: return std::min(a, b);
+        case Map::MAX: return std::max(a, b);
+        case Map::AVERAGE: return (a + b) / 2;
+        case Map::MULTIPLY: return a * b;
+        case Map::SCREEN: return 1 - (1 - a) * (1 - b);
+        case Map::DIFFERENCE: return std::abs(a - b);
+        case Map::XOR: {
+            auto qa = static_cast<int>(std::lround(clamp(a, 0.0f, 1.0f) * 255));
+            auto qb = static_cast<int>(std::lround(clamp(b, 0.0f, 1.0f) * 255));
+            return static_cast<float>(qa ^ qb) / 255;
+        }
+    }
+    return a;
+}
+
+template <Map::Blend mode>
+class BlendImpl : public Map::MapImpl {
+    const int32_t depth;
+
+public:
+    BlendImpl() = delete;
+
+    ~BlendImpl() override = default;
+
+    explicit BlendImpl(int32_t depth)
+        : Map::MapImpl(2 * depth, 2 * depth), depth(depth) {}
+
+private:
+    void operator()(const float *in, float *out) const override {
+        for (int32_t c = 0; c < depth; c++) {
+            out[c] = blendChannel<mode>(in[c], in[depth + c]);
+            out[depth + c] = in[depth + c];
+        }
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        for (int32_t k = 0; k < n; k++) {
+            const float *pair = &in[k * inStride];
+            float *mixed = &out[k * outStride];
+            #pragma omp simd
+            for (int32_t c = 0; c < depth; c++) {
+                mixed[c] = blendChannel<mode>(pair[c], pair[depth + c]);
+                mixed[depth + c] = pair[depth + c];
+            }
+        }
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "blend";
+    }
+};
+
+/**
+ * A Map from [0, 1]^d to R that answers via lookup in a table of samples of
+ * another Map taken on a regular grid.
+ */
+class TableImpl : public Map::MapImpl {
+    const int32_t resolution;
+    const bool interpolate;
+    // strides[j] == resolution^j
+    std::vector<int64_t> strides;
+    std::unique_ptr<float[]> table;
+
+public:
+    TableImpl() = delete;
+
+    ~TableImpl() override = default;
+
+    TableImpl(const Map::MapImpl &f, int32_t resolution, bool interpolate)
+        : Map::MapImpl(f.in_dim, 1),
+          resolution(resolution), interpolate(interpolate),
+          strides(f.in_dim + 1) {
+        strides[0] = 1;
+        for (uint32_t j = 0; j < in_dim; j++)
+            strides[j + 1] = strides[j] * resolution;
+        table.reset(new float[strides[in_dim]]);
+
+        // Sample f one chunk of a grid row (i.e. of the points along axis 0)
+        // at a time. The sample buffer is bounded by MAX_CHUNK rather than by
+        // the resolution, and is allocated on the heap of each thread.
+        const int32_t res = resolution;
+        const int32_t dim = in_dim;
+        const int64_t *stride = strides.data();
+        float *samples = table.get();
+        const int64_t nRows = strides[dim] / res;
+        const int64_t chunksPerRow = (res + MAX_CHUNK - 1) / MAX_CHUNK;
+        const float step = 1.0f / static_cast<float>(res - 1);
+        #pragma omp parallel default(none) \
+                shared(f, res, dim, stride, samples, nRows, chunksPerRow, step)
+        {
+            std::vector<float> pts(static_cast<size_t>(MAX_CHUNK) * dim);
+
+            #pragma omp for
+            for (int64_t c = 0; c < nRows * chunksPerRow; c++) {
+                const int64_t r = c / chunksPerRow;
+                const int32_t first = (c % chunksPerRow) * MAX_CHUNK;
+                const int32_t n = min(MAX_CHUNK, res - first);
+                for (int32_t k = 0; k < n; k++) {
+                    float *pt = &pts[k * dim];
+                    pt[0] = static_cast<float>(first + k) * step;
+                    for (int32_t j = 1; j < dim; j++)
+                        pt[j] = static_cast<float>((r * res / stride[j]) % res)
+                                * step;
+                }
+                f.batch(pts.data(), dim, &samples[r * res + first], 1, n);
+            }
+        }
+    }
+
+private:
+    void operator()(const float *in, float *out) const override {
+        out[0] = interpolate ? lerp(in) : nearest(in);
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        if (interpolate)
+            for (int32_t k = 0; k < n; k++)
+                out[k * outStride] = lerp(&in[k * inStride]);
+        else
+            for (int32_t k = 0; k < n; k++)
+                out[k * outStride] = nearest(&in[k * inStride]);
+    }
+
+    [[nodiscard]]
+    inline float gridCoordinate(float x) const {
+        return clamp(x, 0.0f, 1.0f) * static_cast<float>(resolution - 1);
+    }
+
+    [[nodiscard]]
+    inline float nearest(const float *in) const {
+        int64_t idx = 0;
+        for (uint32_t j = 0; j < in_dim; j++)
+            idx += std::lround(gridCoordinate(in[j])) * strides[j];
+        return table[idx];
+    }
+
+    [[nodiscard]]
+    inline float lerp(const float *in) const {
+        int64_t base = 0;
+        float frac[in_dim];
+        int64_t step[in_dim];
+        for (uint32_t j = 0; j < in_dim; j++) {
+            const float x = gridCoordinate(in[j]);
+            const auto i = min(static_cast<int32_t>(x), resolution - 2);
+            frac[j] = x - static_cast<float>(i);
+            step[j] = strides[j];
+            base += i * strides[j];
+        }
+
+        // Weighted sum over the 2^d corners of the enclosing grid cell.
+        float result = 0;
+        for (uint32_t corner = 0; corner < (1u << in_dim); corner++) {
+            float weight = 1;
+            int64_t idx = base;
+            for (uint32_t j = 0; j < in_dim; j++) {
+                const bool upper = (corner >> j) & 1u;
+                weight *= upper ? frac[j] : 1 - frac[j];
+                idx += upper ? step[j] : 0;
+            }
+            result += weight * table[idx];
+        }
+        return result;
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "table(" + std::to_string(resolution) + ")";
+    }
+};
+
+/**
+ * A register file borrowed from the calling thread's scratch buffer, which
+ * is grown on demand and kept between calls, so that running a Tape does not
+ * allocate once the buffer is large enough.
+ * A call that runs while an enclosing call on the same thread holds the
+ * buffer gets a buffer of its own.
+ */
+class ScratchRegisters {
+    static thread_local std::vector<float> threadScratch;
+    std::vector<float> regs;
+
+public:
+    explicit ScratchRegisters(size_t size)
+        : regs(std::exchange(threadScratch, {})) {
+        if (regs.size() < size)
+            regs.resize(size);
+    }
+
+    ScratchRegisters(const ScratchRegisters &) = delete;
+    ScratchRegisters &operator=(const ScratchRegisters &) = delete;
+
+    ~ScratchRegisters() {
+        if (regs.size() > threadScratch.size())
+            threadScratch = std::move(regs);
+    }
+
+    float *get() {
+        return regs.data();
+    }
+};
+
+thread_local std::vector<float> ScratchRegisters::threadScratch;
+
+/**
+ * Evaluates a tree of MapImpls by running a Tape compiled from it.
+ */
+class TapeImpl : public Map::MapImpl {
+    std::shared_ptr<MapImpl> source;
+    Tape tape;
+
+public:
+    TapeImpl() = delete;
+
+    ~TapeImpl() override = default;
+
+    explicit TapeImpl(std::shared_ptr<MapImpl> source)
+        : Map::MapImpl(source->in_dim, source->out_dim),
+          source(std::move(source)) {
+        Registers in(in_dim);
+        std::iota(in.begin(), in.end(), tape.allocate(in_dim));
+        tape.outputs = tape.lower(*this->source, in);
+        tape.lowered.clear();
+        tape.eliminateDeadInstructions();
+    }
+
+    /**
+     * Returns true if this TapeImpl's tape consists only of a direct
+     * invocation of its source (i.e. compilation bought nothing).
+     */
+    [[nodiscard]]
+    bool trivial() const {
+        return tape.instructions.size() == 1
+               && tape.instructions[0].impl == source;
+    }
+
+private:
+    /** Returns a register file with room for MAX_CHUNK rows. */
+    [[nodiscard]]
+    ScratchRegisters registers() const {
+        return ScratchRegisters(static_cast<size_t>(tape.nRegisters)
+                                * MAX_CHUNK);
+    }
+
+    void operator()(const float *in, float *out) const override {
+        auto scratch = registers();
+        float *regs = scratch.get();
+        std::copy_n(in, in_dim, regs);
+        tape.run(regs, 1);
+        for (uint32_t j = 0; j < out_dim; j++)
+            out[j] = regs[tape.outputs[j]];
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        const auto nRegs = tape.nRegisters;
+        auto scratch = registers();
+        float *regs = scratch.get();
+        for (int32_t k = 0; k < n; k += MAX_CHUNK) {
+            auto chunk = min(n - k, MAX_CHUNK);
+            for (int32_t j = 0; j < chunk; j++)
+                std::copy_n(&in[(k + j) * inStride], in_dim, &regs[j * nRegs]);
+
+            tape.run(regs, chunk);
+
+            for (int32_t j = 0; j < chunk; j++)
+                for (uint32_t o = 0; o < out_dim; o++)
+                    out[(k + j) * outStride + o]
+                        = regs[j * nRegs + tape.outputs[o]];
+        }
+    }
+
+    Registers lower(Tape &outer, const Registers &in) const override {
+        return outer.lower(*source, in);
+    }
+
+    std::shared_ptr<MapImpl> project(int i) override {
+        return std::make_shared<TapeImpl>(source->project(i));
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return "compiled";
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return {source};
+    }
+
+    std::shared_ptr<MapImpl>
+    withChildren(const std::vector<std::shared_ptr<MapImpl>> &c) override {
+        return std::make_shared<TapeImpl>(c[0]);
+    }
+};
+
+/**
+ * Wraps a MapImpl and records how often, on how many inputs, and for how
+ * long (inclusive of the time spent in its children) it is invoked.
+ *
+ * ProfiledImpls are opaque to compilation: each one is lowered to a single
+ * leaf instruction so that its counters observe every evaluation.
+ */
+class ProfiledImpl : public Map::MapImpl {
+public:
+    const std::shared_ptr<MapImpl> inner;
+
+    // updated by the const evaluation methods
+    mutable std::atomic<uint64_t> calls{0};
+    mutable std::atomic<uint64_t> inputs{0};
+    mutable std::atomic<uint64_t> nanoseconds{0};
+
+    explicit ProfiledImpl(std::shared_ptr<MapImpl> inner)
+        : Map::MapImpl(inner->in_dim, inner->out_dim),
+          inner(std::move(inner)) {}
+
+    void reset() {
+        calls = 0;
+        inputs = 0;
+        nanoseconds = 0;
+    }
+
+    [[nodiscard]]
+    std::string name() const override {
+        return inner->name();
+    }
+
+    [[nodiscard]]
+    std::vector<std::shared_ptr<MapImpl>> children() const override {
+        return inner->children();
+    }
+
+    /**
+     * Returns a copy of impl in which every node is wrapped in a
+     * ProfiledImpl. Nodes shared within impl are wrapped once, so that they
+     * share their counters.
+     */
+    static std::shared_ptr<MapImpl> instrument(
+            const std::shared_ptr<MapImpl> &impl,
+            std::unordered_map<const MapImpl *,
+                               std::shared_ptr<MapImpl>> &memo) {
+        if (dynamic_cast<const ProfiledImpl *>(impl.get()))
+            return impl;
+
+        auto it = memo.find(impl.get());
+        if (it != memo.end())
+            return it->second;
+
+        auto c = impl->children();
+        for (auto &child : c)
+            child = instrument(child, memo);
+        auto profiled = std::make_shared<ProfiledImpl>(
+                c.empty() ? impl : impl->withChildren(c));
+        memo.emplace(impl.get(), profiled);
+        return profiled;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    void record(clock::time_point start, int32_t n) const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - start).count();
+        calls.fetch_add(1, std::memory_order_relaxed);
+        inputs.fetch_add(n, std::memory_order_relaxed);
+        nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+    }
+
+    void operator()(const float *in, float *out) const override {
+        auto start = clock::now();
+        (*inner)(in, out);
+        record(start, 1);
+    }
+
+    void batch(const float *in, int32_t inStride,
+               float *out, int32_t outStride, int32_t n) const override {
+        auto start = clock::now();
+        inner->batch(in, inStride, out, outStride, n);
+        record(start, n);
+    }
 };
 
 Map::Map(fn_t fn, int32_t in_dim, int32_t out_dim)
@@ -177,6 +1167,16 @@ pxsort::Map::Map(fp_t fp, int32_t in_dim, int32_t out_dim)
         : pImpl(std::make_shared<FuncPtrImpl>(fp, in_dim, out_dim)),
           inDim(in_dim), outDim(out_dim){}
 
+pxsort::Map::Map(param_fp_t fp, int32_t in_dim, int32_t out_dim,
+                 std::vector<float> params)
+        : pImpl(std::make_shared<ParamFuncPtrImpl>(fp, in_dim, out_dim,
+                                                   std::move(params))),
+          inDim(in_dim), outDim(out_dim){}
+
+pxsort::Map::Map(batch_fp_t fp, int32_t in_dim, int32_t out_dim)
+        : pImpl(std::make_shared<BatchFuncPtrImpl>(fp, in_dim, out_dim)),
+          inDim(in_dim), outDim(out_dim){}
+
 pxsort::Map::Map(std::shared_ptr<MapImpl> pImpl, int32_t in_dim, int32_t out_dim)
     : pImpl(std::move(pImpl)), inDim(in_dim), outDim(out_dim) {}
 
@@ -222,7 +1222,7 @@ Map pxsort::Map::operator^(const Map &that) const {
 Map pxsort::Map::operator[](int i) const {
     int safe_i = modulo(i, outDim);
 
-    return {std::make_shared<ProjectionImpl>(pImpl, safe_i), inDim, 1};
+    return {pImpl->project(safe_i), inDim, 1};
 }
 
 Map pxsort::Map::concatenate(const std::vector<Map> &maps) {
@@ -243,11 +1243,199 @@ void pxsort::Map::operator()(const float *in, float *out) const {
     (*pImpl)(in, out);
 }
 
+void pxsort::Map::operator()(const float *in, int32_t inStride,
+                             float *out, int32_t outStride, int32_t n) const {
+    pImpl->batch(in, inStride, out, outStride, n);
+}
+
+Map pxsort::Map::compile() const {
+    auto tapePImpl = std::make_shared<TapeImpl>(pImpl);
+    if (tapePImpl->trivial())
+        return *this;
+
+    return {tapePImpl, inDim, outDim};
+}
+
+std::optional<std::vector<int32_t>> pxsort::Map::selection() const {
+    Tape tape;
+    Registers in(inDim);
+    std::iota(in.begin(), in.end(), tape.allocate(inDim));
+    tape.outputs = tape.lower(*pImpl, in);
+    tape.eliminateDeadInstructions();
+    if (!tape.instructions.empty())
+        return {};
+
+    return tape.outputs;
+}
+
+Map pxsort::Map::tabulate(int32_t resolution, bool interpolate) const {
+    if (outDim != 1)
+        throw std::invalid_argument(
+                "pxsort::Map: only Maps with outDim == 1 can be tabulated");
+    if (resolution < 2)
+        throw std::invalid_argument(
+                "pxsort::Map: table resolution must be at least 2");
+    if (inDim == 0)
+        throw std::invalid_argument(
+                "pxsort::Map: only Maps with inDim > 0 can be tabulated");
+
+    constexpr int64_t MAX_TABLE_SIZE = 1 << 28;
+    int64_t size = 1;
+    for (int32_t j = 0; j < inDim; j++) {
+        size *= resolution;
+        if (size > MAX_TABLE_SIZE)
+            throw std::invalid_argument(
+                    "pxsort::Map: table would be too large");
+    }
+
+    auto pImpl = std::make_shared<TableImpl>(*compile().pImpl,
+                                             resolution, interpolate);
+    return {pImpl, inDim, 1};
+}
+
 bool pxsort::Map::operator==(const Map &that) const {
     return this->pImpl == that.pImpl;
 }
 
+std::vector<float> pxsort::Map::params() const {
+    auto impl = dynamic_cast<const ParamFuncPtrImpl *>(pImpl.get());
+    if (!impl)
+        throw std::invalid_argument("pxsort::Map: Map is not parameterized.");
+    return impl->getParams();
+}
+
+void pxsort::Map::setParams(const std::vector<float> &params) const {
+    auto impl = dynamic_cast<ParamFuncPtrImpl *>(pImpl.get());
+    if (!impl)
+        throw std::invalid_argument("pxsort::Map: Map is not parameterized.");
+    impl->setParams(params);
+}
+
+Map pxsort::Map::instrumented() const {
+    std::unordered_map<const MapImpl *, std::shared_ptr<MapImpl>> memo;
+    return {ProfiledImpl::instrument(pImpl, memo), inDim, outDim};
+}
+
+std::vector<Map::ProfileEntry> pxsort::Map::profile() const {
+    std::vector<ProfileEntry> entries;
+    std::function<void(const std::shared_ptr<MapImpl> &, int32_t)> visit =
+            [&](const std::shared_ptr<MapImpl> &impl, int32_t depth) {
+        auto profiled = dynamic_cast<const ProfiledImpl *>(impl.get());
+        if (profiled)
+            entries.push_back({profiled->name(), depth,
+                               profiled->calls, profiled->inputs,
+                               profiled->nanoseconds * 1e-9});
+        for (const auto &child : impl->children())
+            visit(child, depth + 1);
+    };
+    visit(pImpl, 0);
+    return entries;
+}
+
+void pxsort::Map::resetProfile() const {
+    std::function<void(const std::shared_ptr<MapImpl> &)> visit =
+            [&](const std::shared_ptr<MapImpl> &impl) {
+        if (auto profiled = dynamic_cast<ProfiledImpl *>(impl.get()))
+            profiled->reset();
+        for (const auto &child : impl->children())
+            visit(child);
+    };
+    visit(pImpl);
+}
+
 Map pxsort::Map::constant(std::vector<float> c, int32_t in_dim) {
     auto pImpl = std::make_shared<ConstantImpl>(c, in_dim);
     return {pImpl, in_dim, static_cast<int32_t>(c.size())};
 }
+
+Map pxsort::Map::identity(int32_t dim) {
+    std::vector<int32_t> indices(dim);
+    std::iota(indices.begin(), indices.end(), 0);
+    return select(indices, dim);
+}
+
+Map pxsort::Map::select(const std::vector<int32_t> &indices, int32_t in_dim) {
+    for (auto idx: indices)
+        if (idx < 0 || idx >= in_dim)
+            throw std::invalid_argument(
+                    "pxsort::Map: selected index out of range");
+
+    auto pImpl = std::make_shared<SelectImpl>(in_dim, indices);
+    return {pImpl, in_dim, static_cast<int32_t>(indices.size())};
+}
+
+Map pxsort::Map::channel(int32_t cn, int32_t depth) {
+    return select({cn}, depth);
+}
+
+Map pxsort::Map::weightedSum(const std::vector<float> &weights) {
+    auto pImpl = std::make_shared<WeightedSumImpl>(weights);
+    return {pImpl, static_cast<int32_t>(weights.size()), 1};
+}
+
+Map pxsort::Map::luminance() {
+    return weightedSum({0.2126, 0.7152, 0.0722});
+}
+
+Map pxsort::Map::lightness() {
+    using Impl = RGBProjectionImpl<kernels::LIGHTNESS>;
+    return {std::make_shared<Impl>(), 3, 1};
+}
+
+Map pxsort::Map::value() {
+    using Impl = RGBProjectionImpl<kernels::VALUE>;
+    return {std::make_shared<Impl>(), 3, 1};
+}
+
+Map pxsort::Map::hue() {
+    using Impl = RGBProjectionImpl<kernels::HUE>;
+    return {std::make_shared<Impl>(), 3, 1};
+}
+
+Map pxsort::Map::hsvSaturation() {
+    using Impl = RGBProjectionImpl<kernels::HSV_SATURATION>;
+    return {std::make_shared<Impl>(), 3, 1};
+}
+
+Map pxsort::Map::hslSaturation() {
+    using Impl = RGBProjectionImpl<kernels::HSL_SATURATION>;
+    return {std::make_shared<Impl>(), 3, 1};
+}
+
+Map pxsort::Map::toHSV() {
+    return hue() ^ hsvSaturation() ^ value();
+}
+
+Map pxsort::Map::toHSL() {
+    return hue() ^ hslSaturation() ^ lightness();
+}
+
+Map pxsort::Map::swap(const std::vector<int32_t> &channels, int32_t depth) {
+    std::vector<int32_t> indices(2 * depth);
+    std::iota(indices.begin(), indices.end(), 0);
+    for (auto cn: channels) {
+        if (cn < 0 || cn >= depth)
+            throw std::invalid_argument(
+                    "pxsort::Map: swapped channel out of range");
+        indices[cn] = depth + cn;
+        indices[depth + cn] = cn;
+    }
+    return select(indices, 2 * depth);
+}
+
+Map pxsort::Map::blend(Blend mode, int32_t depth) {
+    std::shared_ptr<MapImpl> pImpl;
+    switch (mode) {
+        case MIN: pImpl = std::make_shared<BlendImpl<MIN>>(depth); break;
+        case MAX: pImpl = std::make_shared<BlendImpl<MAX>>(depth); break;
+        case AVERAGE: pImpl = std::make_shared<BlendImpl<AVERAGE>>(depth); break;
+        case MULTIPLY: pImpl = std::make_shared<BlendImpl<MULTIPLY>>(depth); break;
+        case SCREEN: pImpl = std::make_shared<BlendImpl<SCREEN>>(depth); break;
+        case DIFFERENCE:
+            pImpl = std::make_shared<BlendImpl<DIFFERENCE>>(depth); break;
+        case XOR: pImpl = std::make_shared<BlendImpl<XOR>>(depth); break;
+        default:
+            throw std::invalid_argument("pxsort::Map: unknown blend mode");
+    }
+    return {pImpl, 2 * depth, 2 * depth};
+}
@@ -4,6 +4,9 @@
 #include <functional>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 #include "fwd.h"
 
 namespace pxsort {
@@ -16,9 +19,51 @@ namespace pxsort {
         class MapImpl;
 
         using fp_t = void(*)(const float *, int32_t, float *, int32_t);
+        using batch_fp_t = void(*)(const float *, int32_t, int32_t,
+                                   float *, int32_t, int32_t, int32_t);
+        using param_fp_t = void(*)(const float *, int32_t, float *, int32_t,
+                                   const float *, int32_t);
         using fn_t = std::function<void(const float *, int32_t,
                                         float *, int32_t)>;
 
+        /**
+         * Ways of combining a pair of pixels' channel values.
+         * All channel values are assumed to lie in [0, 1].
+         */
+        enum Blend {
+            /** min(a, b) */
+            MIN,
+            /** max(a, b) */
+            MAX,
+            /** (a + b) / 2 */
+            AVERAGE,
+            /** a * b */
+            MULTIPLY,
+            /** 1 - (1 - a) * (1 - b) */
+            SCREEN,
+            /** |a - b| */
+            DIFFERENCE,
+            /** Bitwise XOR of a and b, quantized to 8-bit integers. */
+            XOR
+        };
+
+        /**
+         * Counters recorded for a single node of an instrumented Map.
+         */
+        struct ProfileEntry {
+            /** A description of the node (e.g. "composition", "hue"). */
+            std::string name;
+            /** The node's depth in the Map's expression tree (root is 0). */
+            int32_t depth;
+            /** The number of times the node was invoked. */
+            uint64_t calls;
+            /** The number of inputs the node was evaluated on. */
+            uint64_t inputs;
+            /** Cumulative time spent evaluating the node (including its
+             *  children), in seconds. */
+            double seconds;
+        };
+
         /**
          * The dimension of this Map's input.
          */
@@ -63,6 +108,46 @@ namespace pxsort {
          */
         Map(fp_t fp, int32_t in_dim, int32_t out_dim);
 
+        /**
+         * Creates a new Map from a batched function pointer.
+         *
+         * Like the fp_t constructor, this is intended for use with
+         *   runtime-defined (e.g. Numba) functions, but the function is
+         *   invoked once per batch of inputs rather than once per input.
+         *
+         * @param fp The function pointer to use for this map.
+         * This function's arguments are treated as:
+         *     (float *in_ptr, int in_size, int in_stride,
+         *      float *out_ptr, int out_size, int out_stride, int n)
+         * The kth input is located at &in_ptr[k * in_stride] and fp is
+         *   expected to write the kth output to &out_ptr[k * out_stride], for
+         *   each k in [0, n).
+         * @param in_dim The dimension of the input to this map (and to fp).
+         * @param out_dim The dimension of the output from this map (and from fp).
+         */
+        Map(batch_fp_t fp, int32_t in_dim, int32_t out_dim);
+
+        /**
+         * Creates a new Map from a parameterized function pointer.
+         *
+         * Like the fp_t constructor, this is intended for use with
+         *   runtime-defined (e.g. Numba) functions. The function is
+         *   additionally passed a vector of parameters (e.g. thresholds,
+         *   weights or a reference colour), which can be changed with
+         *   setParams without recompiling the function or rebuilding any
+         *   Map that contains this one.
+         *
+         * @param fp The function pointer to use for this map.
+         * This function's arguments are treated as:
+         *     (float *in_ptr, int in_size, float *out_ptr, int out_size,
+         *      float *params_ptr, int n_params)
+         * @param in_dim The dimension of the input to this map (and to fp).
+         * @param out_dim The dimension of the output from this map (and from fp).
+         * @param params The initial parameters passed to fp.
+         */
+        Map(param_fp_t fp, int32_t in_dim, int32_t out_dim,
+            std::vector<float> params);
+
         /**
          * Creates a new Map from a std::function object.
          * @param fn The std::function to use for this map.
@@ -106,6 +191,120 @@ namespace pxsort {
          */
         static Map constant(std::vector<float> c, int32_t in_dim = 0);
 
+        /**
+         * Returns the identity Map on R^dim.
+         * @param dim
+         * @return
+         */
+        static Map identity(int32_t dim);
+
+        /**
+         * Returns a Map that selects elements of its input.
+         * The resulting Map's ith output is its indices[i]th input, so this
+         *   can be used to pick, reorder (permute) or repeat channels.
+         * @param indices Input indices in the range [0, ..., in_dim - 1].
+         * @param in_dim The dimension of the resulting Map's input.
+         * @throws std::invalid_argument If an index is out of range.
+         * @return
+         */
+        static Map select(const std::vector<int32_t> &indices, int32_t in_dim);
+
+        /**
+         * Returns a Map from R^depth to R that picks channel cn of a pixel.
+         * @param cn An integer in the range [0, ..., depth - 1].
+         * @param depth The pixel depth.
+         * @return
+         */
+        static Map channel(int32_t cn, int32_t depth);
+
+        /**
+         * Returns a Map from R^d to R that computes a weighted sum of its
+         *   input's elements, where d = weights.size().
+         * @param weights
+         * @return
+         */
+        static Map weightedSum(const std::vector<float> &weights);
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1] that computes the (Rec. 709)
+         *   relative luminance of an RGB pixel.
+         * NOTE: all colour-model Maps expect RGB channel order. Compose with
+         *   Map::select (e.g. select({2, 1, 0}, 3)) for other orders.
+         * @return
+         */
+        static Map luminance();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1] that computes the HSL
+         *   lightness (i.e. (max + min) / 2) of an RGB pixel.
+         * @return
+         */
+        static Map lightness();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1] that computes the HSV value
+         *   (i.e. max) of an RGB pixel.
+         * @return
+         */
+        static Map value();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1) that computes the hue of an
+         *   RGB pixel, as a fraction of a full turn.
+         * @return
+         */
+        static Map hue();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1] that computes the HSV
+         *   saturation of an RGB pixel.
+         * @return
+         */
+        static Map hsvSaturation();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1] that computes the HSL
+         *   saturation of an RGB pixel.
+         * @return
+         */
+        static Map hslSaturation();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1]^3 that converts an RGB pixel
+         *   to HSV.
+         * @return
+         */
+        static Map toHSV();
+
+        /**
+         * Returns a Map from [0, 1]^3 to [0, 1]^3 that converts an RGB pixel
+         *   to HSL.
+         * @return
+         */
+        static Map toHSL();
+
+        /**
+         * Returns a pixel mixer (i.e. a Map from R^2d to R^2d, where d is
+         *   pixel depth) that swaps the given channels of a pair of pixels.
+         * @param channels The channels to swap. Channels not listed are left
+         *   in place.
+         * @param depth The pixel depth d.
+         * @throws std::invalid_argument If a channel is out of range.
+         * @return
+         */
+        static Map swap(const std::vector<int32_t> &channels, int32_t depth);
+
+        /**
+         * Returns a pixel mixer (i.e. a Map from [0, 1]^2d to [0, 1]^2d, where
+         *   d is pixel depth) that blends the second pixel of a pair into the
+         *   first, channel by channel. The second pixel is passed through
+         *   unchanged.
+         * @param mode How to combine channel values.
+         * @param depth The pixel depth d.
+         * @return
+         */
+        static Map blend(Blend mode, int32_t depth);
+
         /**
          * Function "fork" operator.
          * Let fp: A -> B, g: A -> C
@@ -121,6 +320,9 @@ namespace pxsort {
         /**
          * Projection operator.
          * Produces the ith projection of this Map.
+         * Sub-maps of this Map (e.g. branches of a fork or concatenation) that
+         *   do not contribute to the ith output are not evaluated by the
+         *   resulting Map.
          * @param i An integer in the range [0, ... , nPixels - 1]
          * @return The ith projection of this map.
          */
@@ -147,6 +349,117 @@ namespace pxsort {
          */
         void operator()(const float *in, float *out) const;
 
+        /**
+         * Invoke this map on a batch of n inputs.
+         * WARNING: this function is unsafe! The caller is responsible for
+         *     ensuring that the provided arrays are valid, and properly
+         *     initialized.
+         * @param in A C array containing the inputs to this Map. The kth
+         *     input is located at &in[k * inStride], and has length inDim.
+         * @param inStride Distance (in floats) between consecutive inputs.
+         * @param out A C array to return this Map's outputs via. The kth
+         *     output is written to &out[k * outStride].
+         * @param outStride Distance (in floats) between consecutive outputs.
+         * @param n The number of inputs in the batch.
+         */
+        void operator()(const float *in, int32_t inStride,
+                        float *out, int32_t outStride, int32_t n) const;
+
+        /**
+         * Returns a Map that approximates this Map via table lookup.
+         * This Map is sampled once on a regular grid over [0, 1]^inDim with
+         *   the given number of points along each axis (i.e. at i / (r - 1)
+         *   for i in [0, r)), and the resulting Map answers from the table.
+         * This is intended for expensive projections of pixels from low bit
+         *   depth sources, e.g. resolution 256 reproduces an 8-bit RGB
+         *   projection exactly with nearest-neighbour lookup.
+         * Inputs outside of [0, 1]^inDim are clamped to it.
+         * @param resolution The number of grid points along each axis (r).
+         * @param interpolate If true, results are multilinearly interpolated
+         *   between grid points; otherwise the nearest grid point is used.
+         * @throws std::invalid_argument If outDim != 1, inDim == 0,
+         *   resolution < 2, or the table would have more than 2^28 entries.
+         * @return
+         */
+        [[nodiscard]]
+        Map tabulate(int32_t resolution, bool interpolate = false) const;
+
+        /**
+         * Returns a Map that computes the same function as this Map, but
+         *   that evaluates it by running a flat sequence of instructions over
+         *   a single preallocated register file.
+         * Compositions, concatenations, forks and projections are resolved
+         *   when the tape is compiled, so evaluating the resulting Map only
+         *   invokes this Map's leaf functions (i.e. function pointers,
+         *   function objects and constants) in a single linear pass.
+         * Sub-maps that appear in several places (e.g. m in m[0] ^ m[2])
+         *   are evaluated once per input, provided they are applied to the
+         *   same values.
+         * @return A compiled copy of this Map.
+         */
+        [[nodiscard]]
+        Map compile() const;
+
+        /**
+         * Determines whether this Map only selects elements of its input
+         *   (see Map::select), e.g. because it is a composition, fork or
+         *   concatenation of selections such as Map::swap.
+         * @return The input index of each of this Map's outputs if this Map
+         *   is a selection, and std::nullopt otherwise.
+         */
+        [[nodiscard]]
+        std::optional<std::vector<int32_t>> selection() const;
+
+        /**
+         * Returns the parameters of a Map created from a param_fp_t.
+         * @throws std::invalid_argument If this Map is not parameterized.
+         */
+        [[nodiscard]]
+        std::vector<float> params() const;
+
+        /**
+         * Replaces the parameters of a Map created from a param_fp_t.
+         * The change is seen by every Map containing this one, including
+         *   compiled and instrumented copies (but not tabulated ones, which
+         *   sample their source once).
+         * WARNING: parameters must not be changed while a Map containing
+         *   this one is being evaluated (e.g. during a sort).
+         * @param params The new parameters. Must have the same size as the
+         *   current parameters.
+         * @throws std::invalid_argument If this Map is not parameterized or
+         *   the number of parameters differs.
+         */
+        void setParams(const std::vector<float> &params) const;
+
+        /**
+         * Returns a copy of this Map that records, for each node of its
+         *   expression tree (i.e. for this Map and each Map it is composed
+         *   of), the number of times the node is invoked and the cumulative
+         *   time spent evaluating it.
+         * Instrumentation has a cost per invocation, and instrumented Maps
+         *   are not flattened by compile(), so this is intended for
+         *   diagnosing slow Maps rather than for production use.
+         * @return An instrumented copy of this Map.
+         */
+        [[nodiscard]]
+        Map instrumented() const;
+
+        /**
+         * Returns the counters recorded by an instrumented Map, with one
+         *   entry per node in pre-order (i.e. each node is followed by its
+         *   children).
+         * Nodes shared by several parts of the tree share their counters.
+         * @return The recorded counters, or an empty vector if this Map is
+         *   not instrumented.
+         */
+        [[nodiscard]]
+        std::vector<ProfileEntry> profile() const;
+
+        /**
+         * Resets the counters recorded by an instrumented Map to zero.
+         */
+        void resetProfile() const;
+
         bool operator==(const Map &other) const;
 
     private:
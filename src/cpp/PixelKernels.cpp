@@ -0,0 +1,304 @@
+#include "PixelKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PXSORT_X86
+#endif
+
+using namespace pxsort;
+using namespace pxsort::kernels;
+
+namespace {
+
+    template <RGBProjection p>
+    void projectPortable(const float *in, int32_t inStride,
+                         float *out, int32_t outStride, int32_t n) {
+        #pragma omp simd
+        for (int32_t k = 0; k < n; k++) {
+            const float *px = &in[k * inStride];
+            out[k * outStride] = kernels::project<p>(px[0], px[1], px[2]);
+        }
+    }
+
+    void weightedSumPortable(const float *weights, int32_t dim,
+                             const float *in, int32_t inStride,
+                             float *out, int32_t outStride, int32_t n) {
+        #pragma omp simd
+        for (int32_t k = 0; k < n; k++) {
+            float sum = 0;
+            for (int32_t j = 0; j < dim; j++)
+                sum += weights[j] * in[k * inStride + j];
+            out[k * outStride] = sum;
+        }
+    }
+
+    /**
+     * Packs a key and its index into an integer, such that integers compare
+     * like (key, index) pairs. The result is signed, since AVX2 has no
+     * unsigned 64-bit comparison.
+     */
+    inline int64_t packKey(float key, int32_t idx) {
+        const uint64_t packed = static_cast<uint64_t>(orderedBits(key)) << 32
+                                | static_cast<uint32_t>(idx);
+        return static_cast<int64_t>(packed ^ (1ull << 63));
+    }
+
+    /**
+     * Compare-exchanges x[b + i] and x[b + j + i] for i in [0, j), leaving the
+     * smaller of each pair first if ascending, and last otherwise.
+     */
+    inline void compareExchange(int64_t *x, int32_t b, int32_t j,
+                                bool ascending) {
+        #pragma omp simd
+        for (int32_t i = b; i < b + j; i++) {
+            const int64_t lo = std::min(x[i], x[i + j]);
+            const int64_t hi = std::max(x[i], x[i + j]);
+            x[i] = ascending ? lo : hi;
+            x[i + j] = ascending ? hi : lo;
+        }
+    }
+
+    /**
+     * Sorts n packed keys with a bitonic sorting network.
+     * @param n A power of 2.
+     */
+    void bitonicPortable(int64_t *x, int32_t n) {
+        for (int32_t k = 2; k <= n; k *= 2)
+            for (int32_t j = k / 2; j > 0; j /= 2)
+                for (int32_t b = 0; b < n; b += 2 * j)
+                    compareExchange(x, b, j, (b & k) == 0);
+    }
+
+#ifdef PXSORT_X86
+
+    /**
+     * Offsets of 8 consecutive strided pixels, relative to the first.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i strideOffsets(int32_t stride) {
+        return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                  _mm256_set1_epi32(stride));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256 gather(const float *base, __m256i offsets) {
+        return _mm256_i32gather_ps(base, offsets, sizeof(float));
+    }
+
+    __attribute__((target("avx2")))
+    inline void scatter(float *out, int32_t outStride, __m256 v) {
+        if (outStride == 1) {
+            _mm256_storeu_ps(out, v);
+            return;
+        }
+        alignas(32) float tmp[8];
+        _mm256_store_ps(tmp, v);
+        for (int32_t j = 0; j < 8; j++)
+            out[j * outStride] = tmp[j];
+    }
+
+    /**
+     * Vectorized counterpart of kernels::project. Performs the same
+     * floating-point operations, so results are identical.
+     */
+    template <RGBProjection p>
+    __attribute__((target("avx2")))
+    inline __m256 projectAVX2(__m256 r, __m256 g, __m256 b) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1);
+        const __m256 half = _mm256_set1_ps(0.5);
+
+        const __m256 hi = _mm256_max_ps(_mm256_max_ps(r, g), b);
+        const __m256 lo = _mm256_min_ps(_mm256_min_ps(r, g), b);
+        const __m256 c = _mm256_sub_ps(hi, lo);
+
+        switch (p) {
+            case LIGHTNESS:
+                return _mm256_mul_ps(_mm256_add_ps(hi, lo), half);
+
+            case VALUE:
+                return hi;
+
+            case HUE: {
+                const __m256 hr = _mm256_div_ps(_mm256_sub_ps(g, b), c);
+                const __m256 hg = _mm256_add_ps(
+                        _mm256_set1_ps(2), _mm256_div_ps(_mm256_sub_ps(b, r), c));
+                const __m256 hb = _mm256_add_ps(
+                        _mm256_set1_ps(4), _mm256_div_ps(_mm256_sub_ps(r, g), c));
+
+                __m256 h = _mm256_blendv_ps(
+                        hb, hg, _mm256_cmp_ps(hi, g, _CMP_EQ_OQ));
+                h = _mm256_blendv_ps(h, hr, _mm256_cmp_ps(hi, r, _CMP_EQ_OQ));
+                h = _mm256_div_ps(h, _mm256_set1_ps(6));
+                h = _mm256_blendv_ps(h, _mm256_add_ps(h, one),
+                                     _mm256_cmp_ps(h, zero, _CMP_LT_OQ));
+                h = _mm256_blendv_ps(h, zero,
+                                     _mm256_cmp_ps(h, one, _CMP_GE_OQ));
+                return _mm256_blendv_ps(h, zero,
+                                        _mm256_cmp_ps(c, zero, _CMP_EQ_OQ));
+            }
+
+            case HSV_SATURATION:
+                return _mm256_blendv_ps(_mm256_div_ps(c, hi), zero,
+                                        _mm256_cmp_ps(hi, zero, _CMP_EQ_OQ));
+
+            case HSL_SATURATION: {
+                const __m256 l = _mm256_mul_ps(_mm256_add_ps(hi, lo), half);
+                const __m256 signMask = _mm256_set1_ps(-0.0f);
+                const __m256 dist = _mm256_andnot_ps(
+                        signMask,
+                        _mm256_sub_ps(_mm256_add_ps(l, l), one));
+                const __m256 s = _mm256_div_ps(c, _mm256_sub_ps(one, dist));
+                const __m256 isExtreme = _mm256_or_ps(
+                        _mm256_cmp_ps(l, zero, _CMP_EQ_OQ),
+                        _mm256_cmp_ps(l, one, _CMP_EQ_OQ));
+                return _mm256_blendv_ps(s, zero, isExtreme);
+            }
+        }
+        return zero;
+    }
+
+    template <RGBProjection p>
+    __attribute__((target("avx2")))
+    void projectBatchAVX2(const float *in, int32_t inStride,
+                          float *out, int32_t outStride, int32_t n) {
+        const __m256i offsets = strideOffsets(inStride);
+
+        int32_t k = 0;
+        for (; k + 8 <= n; k += 8) {
+            const float *px = &in[k * inStride];
+            const __m256 r = gather(px, offsets);
+            const __m256 g = gather(&px[1], offsets);
+            const __m256 b = gather(&px[2], offsets);
+            scatter(&out[k * outStride], outStride, projectAVX2<p>(r, g, b));
+        }
+
+        projectPortable<p>(&in[k * inStride], inStride,
+                           &out[k * outStride], outStride, n - k);
+    }
+
+    __attribute__((target("avx2")))
+    void weightedSumAVX2(const float *weights, int32_t dim,
+                         const float *in, int32_t inStride,
+                         float *out, int32_t outStride, int32_t n) {
+        const __m256i offsets = strideOffsets(inStride);
+
+        int32_t k = 0;
+        for (; k + 8 <= n; k += 8) {
+            const float *px = &in[k * inStride];
+            __m256 sum = _mm256_setzero_ps();
+            for (int32_t j = 0; j < dim; j++)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(
+                        _mm256_set1_ps(weights[j]), gather(&px[j], offsets)));
+            scatter(&out[k * outStride], outStride, sum);
+        }
+
+        weightedSumPortable(weights, dim, &in[k * inStride], inStride,
+                            &out[k * outStride], outStride, n - k);
+    }
+
+    /**
+     * Vectorized counterpart of bitonicPortable: exchanges between pairs of
+     * elements at least 4 apart are computed 4 pairs at a time.
+     */
+    __attribute__((target("avx2")))
+    void bitonicAVX2(int64_t *x, int32_t n) {
+        for (int32_t k = 2; k <= n; k *= 2)
+            for (int32_t j = k / 2; j > 0; j /= 2)
+                for (int32_t b = 0; b < n; b += 2 * j) {
+                    const bool ascending = (b & k) == 0;
+                    if (j < 4) {
+                        compareExchange(x, b, j, ascending);
+                        continue;
+                    }
+
+                    for (int32_t i = b; i < b + j; i += 4) {
+                        auto *p = reinterpret_cast<__m256i *>(&x[i]);
+                        auto *q = reinterpret_cast<__m256i *>(&x[i + j]);
+                        const __m256i u = _mm256_loadu_si256(p);
+                        const __m256i v = _mm256_loadu_si256(q);
+                        const __m256i gt = _mm256_cmpgt_epi64(u, v);
+                        const __m256i lo = _mm256_blendv_epi8(u, v, gt);
+                        const __m256i hi = _mm256_blendv_epi8(v, u, gt);
+                        _mm256_storeu_si256(p, ascending ? lo : hi);
+                        _mm256_storeu_si256(q, ascending ? hi : lo);
+                    }
+                }
+    }
+
+#endif // PXSORT_X86
+
+    template <RGBProjection p>
+    void projectBatch(const float *in, int32_t inStride,
+                      float *out, int32_t outStride, int32_t n) {
+#ifdef PXSORT_X86
+        if (usingAVX2())
+            return projectBatchAVX2<p>(in, inStride, out, outStride, n);
+#endif
+        projectPortable<p>(in, inStride, out, outStride, n);
+    }
+
+    void bitonicSort(int64_t *x, int32_t n) {
+#ifdef PXSORT_X86
+        if (usingAVX2())
+            return bitonicAVX2(x, n);
+#endif
+        bitonicPortable(x, n);
+    }
+}
+
+bool pxsort::kernels::usingAVX2() {
+#ifdef PXSORT_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void pxsort::kernels::project(RGBProjection p,
+                              const float *in, int32_t inStride,
+                              float *out, int32_t outStride, int32_t n) {
+    switch (p) {
+        case LIGHTNESS:
+            return projectBatch<LIGHTNESS>(in, inStride, out, outStride, n);
+        case VALUE:
+            return projectBatch<VALUE>(in, inStride, out, outStride, n);
+        case HUE:
+            return projectBatch<HUE>(in, inStride, out, outStride, n);
+        case HSV_SATURATION:
+            return projectBatch<HSV_SATURATION>(in, inStride,
+                                                out, outStride, n);
+        case HSL_SATURATION:
+            return projectBatch<HSL_SATURATION>(in, inStride,
+                                                out, outStride, n);
+    }
+}
+
+void pxsort::kernels::weightedSum(const float *weights, int32_t dim,
+                                  const float *in, int32_t inStride,
+                                  float *out, int32_t outStride, int32_t n) {
+#ifdef PXSORT_X86
+    if (usingAVX2())
+        return weightedSumAVX2(weights, dim, in, inStride, out, outStride, n);
+#endif
+    weightedSumPortable(weights, dim, in, inStride, out, outStride, n);
+}
+
+void pxsort::kernels::argsortSmall(const float *keys, int32_t n,
+                                   int32_t *order) {
+    int32_t size = 1;
+    while (size < n)
+        size *= 2;
+
+    // padding sorts after every key
+    int64_t x[MAX_NETWORK_SORT];
+    for (int32_t i = 0; i < n; i++)
+        x[i] = packKey(keys[i], i);
+    std::fill(x + n, x + size, INT64_MAX);
+
+    bitonicSort(x, size);
+
+    for (int32_t r = 0; r < n; r++)
+        order[r] = static_cast<int32_t>(x[r] & 0xffffffff);
+}
@@ -0,0 +1,134 @@
+#ifndef PXSORT_PIXELKERNELS_H
+#define PXSORT_PIXELKERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Native kernels for computing built-in pixel projections over arrays of
+ * interleaved pixels.
+ *
+ * The batch kernels are vectorized: on CPUs that support AVX2 they compute
+ * 8 pixels at a time, and otherwise fall back to a portable implementation
+ * (which the compiler vectorizes for the baseline instruction set).
+ * The implementation is selected at runtime.
+ */
+namespace pxsort::kernels {
+
+    /** Colour-model projections of an RGB pixel with channels in [0, 1]. */
+    enum RGBProjection {
+        /** HSL lightness: (max + min) / 2 */
+        LIGHTNESS,
+        /** HSV value: max */
+        VALUE,
+        /** Hue, as a fraction of a full turn. */
+        HUE,
+        /** HSV saturation. */
+        HSV_SATURATION,
+        /** HSL saturation. */
+        HSL_SATURATION
+    };
+
+    /**
+     * Computes a projection of a single RGB pixel.
+     */
+    template <RGBProjection p>
+    inline float project(float r, float g, float b) {
+        const float hi = std::max({r, g, b});
+        const float lo = std::min({r, g, b});
+        const float c = hi - lo;
+
+        switch (p) {
+            case LIGHTNESS:
+                return (hi + lo) / 2;
+
+            case VALUE:
+                return hi;
+
+            case HUE: {
+                if (c == 0)
+                    return 0;
+                float h = hi == r ? (g - b) / c
+                        : hi == g ? 2 + (b - r) / c
+                                  : 4 + (r - g) / c;
+                h /= 6;
+                if (h >= 0)
+                    return h;
+                // h + 1 rounds up to 1 when h is a tiny negative number
+                h += 1;
+                return h >= 1 ? 0 : h;
+            }
+
+            case HSV_SATURATION:
+                return hi == 0 ? 0 : c / hi;
+
+            case HSL_SATURATION: {
+                const float l = (hi + lo) / 2;
+                return (l == 0 || l == 1) ? 0 : c / (1 - std::abs(2 * l - 1));
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Computes a projection of n strided RGB pixels.
+     * @param p The projection to compute.
+     * @param in The kth pixel is located at &in[k * inStride].
+     * @param inStride Distance (in floats) between consecutive pixels.
+     * @param out The kth projection is written to out[k * outStride].
+     * @param outStride Distance (in floats) between consecutive outputs.
+     * @param n The number of pixels.
+     */
+    void project(RGBProjection p,
+                 const float *in, int32_t inStride,
+                 float *out, int32_t outStride, int32_t n);
+
+    /**
+     * Computes the weighted sum of the elements of n strided vectors.
+     * @param weights Array of length dim.
+     * @param dim The length of each vector.
+     * @param in The kth vector is located at &in[k * inStride].
+     * @param inStride Distance (in floats) between consecutive vectors.
+     * @param out The kth sum is written to out[k * outStride].
+     * @param outStride Distance (in floats) between consecutive outputs.
+     * @param n The number of vectors.
+     */
+    void weightedSum(const float *weights, int32_t dim,
+                     const float *in, int32_t inStride,
+                     float *out, int32_t outStride, int32_t n);
+
+    /**
+     * Maps a float to an unsigned integer with the same ordering, by flipping
+     * the sign bit of non-negative floats and all bits of negative floats.
+     */
+    inline uint32_t orderedBits(float f) {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+    }
+
+    /** The maximum number of keys that argsortSmall sorts. */
+    constexpr int32_t MAX_NETWORK_SORT = 128;
+
+    /**
+     * Stably sorts n short keys with a bitonic sorting network, and sets
+     * order[r] to the index of the key of rank r.
+     * Keys are compared by orderedBits, with ties broken by index, so the
+     * result is the same as that of a stable radix sort. The network has
+     * no data-dependent branches, and its compare-exchanges are vectorized.
+     * @param keys
+     * @param n At most MAX_NETWORK_SORT.
+     * @param order An array of n ints.
+     */
+    void argsortSmall(const float *keys, int32_t n, int32_t *order);
+
+    /**
+     * Returns true if the AVX2 implementations of the batch kernels are in
+     * use.
+     */
+    bool usingAVX2();
+}
+
+#endif //PXSORT_PIXELKERNELS_H
@@ -158,6 +158,14 @@ int Filter::size() const {
     return indices.size();
 }
 
+bool SegmentPixels::contiguous() const {
+    return dynamic_cast<const Subarray *>(view.get()) != nullptr;
+}
+
+bool SegmentPixels::aliases(const SegmentPixels &other) const {
+    return pixelData == other.pixelData;
+}
+
 int SegmentPixels::depth() const {
     return pixelDepth;
 }
@@ -104,6 +104,24 @@ public:
     [[nodiscard]]
     int depth() const;
 
+    /**
+     * Returns true if this SegmentPixels' indexable pixels are contiguous in
+     * the backing array (i.e. px(i) == px(0) + i * depth()).
+     * @return
+     */
+    [[nodiscard]]
+    bool contiguous() const;
+
+    /**
+     * Returns true if this SegmentPixels and other are views of the same
+     * backing array, so that writing to the pixels of one may change the
+     * pixels of the other.
+     * @param other
+     * @return
+     */
+    [[nodiscard]]
+    bool aliases(const SegmentPixels &other) const;
+
     /**
      * Returns a (borrowed) pointer to the pixel safe_ptr the given index.
      * @param viewIdx
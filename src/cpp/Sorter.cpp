@@ -1,46 +1,457 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <vector>
 #include <memory>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <omp.h>
+#include "PixelKernels.h"
 #include "Sorter.h"
 #include "Segment.h"
 #include "util.h"
 
 using namespace pxsort;
 
+/**
+ * Number of pixels that are gathered and passed to a Map in a single batch.
+ */
+constexpr int BATCH_SIZE = 256;
+
+/**
+ * Minimum number of pixels per block when bucketing pixels in parallel.
+ */
+constexpr int MIN_SCATTER_BLOCK = 4096;
+
+/**
+ * Minimum number of nodes in a level of a heap for the level's bubble-down
+ * passes to be run in parallel.
+ */
+constexpr long MIN_PARALLEL_HEAP_LEVEL = 256;
+
+/**
+ * Minimum number of compared pairs in a phase of an odd-even transposition
+ * sort for the phase to be run in parallel.
+ */
+constexpr int MIN_PARALLEL_PHASE = 4 * BATCH_SIZE;
+
+/**
+ * Minimum number of pixels for a loop over the pixels of a segment to be run
+ * in parallel. Below this, the cost of entering a parallel region outweighs
+ * the work of the loop (e.g. for the many short segments of a partition).
+ */
+constexpr int MIN_PARALLEL_PIXELS = 4096;
+
+/**
+ * Minimum number of pixels for the merges of a level of a merge sort to be
+ * run in parallel.
+ */
+constexpr int MIN_PARALLEL_MERGE = 4 * BATCH_SIZE;
+
+/**
+ * Number of sampled keys per bucket, and minimum number of sampled keys, used
+ * to estimate the boundaries of equal-population buckets.
+ */
+constexpr int QUANTILE_SAMPLES_PER_BUCKET = 16;
+constexpr int MIN_QUANTILE_SAMPLES = 1024;
+
+/**
+ * Computes the projection of each pixel in pixels, writing the result for the
+ * ith pixel to keys[i]. The projection is invoked once per batch of pixels
+ * rather than once per pixel; pixels are read in place when they are
+ * contiguous, and are otherwise gathered into a contiguous batch.
+ */
+void projectAll(const SegmentPixels &pixels, const Map &project, float *keys) {
+    const int nPixels = pixels.size();
+    const int nChannels = pixels.depth();
+    const bool inPlace = pixels.contiguous();
+
+    float px[BATCH_SIZE * nChannels];
+    #pragma omp parallel for default(none) private(px) \
+            shared(nPixels, nChannels, inPlace, pixels, project, keys) \
+            if(nPixels > BATCH_SIZE)
+    for (int start = 0; start < nPixels; start += BATCH_SIZE) {
+        const int n = min(BATCH_SIZE, nPixels - start);
+        if (inPlace) {
+            project(pixels.px(start), nChannels, &keys[start], 1, n);
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+            std::copy_n(pixels.px(start + i), nChannels, &px[i * nChannels]);
+
+        project(px, nChannels, &keys[start], 1, n);
+    }
+}
+
+/**
+ * Stable counting sort of pixels by bucket: sets sortedIdx[i] to the
+ * position of pixel i when pixels are ordered by bucket, with pixels in the
+ * same bucket kept in their original order.
+ * Pixels are split into one contiguous block per thread. Each thread counts
+ * its block's pixels per bucket; an exclusive prefix scan over
+ * (bucket, block) then gives each block its own range of slots in each
+ * bucket, which the block's thread fills in order. The result does not
+ * depend on the number of threads or on scheduling, and no atomics are
+ * needed.
+ * @param bkt The bucket of each pixel, in [0, nBuckets).
+ */
+void stableScatter(const int *bkt, int nPixels, int nBuckets, int *sortedIdx) {
+    const int nBlocks = clamp(nPixels / MIN_SCATTER_BLOCK,
+                              1, omp_get_max_threads());
+    const auto blockStart = [=](int t) {
+        return static_cast<int>(static_cast<long>(nPixels) * t / nBlocks);
+    };
+
+    // offsets[t * nBuckets + b]: number of pixels in block t in bucket b,
+    // and then the first slot of bucket b that belongs to block t
+    std::vector<int> offsets(static_cast<size_t>(nBlocks) * nBuckets, 0);
+    #pragma omp parallel for default(none) \
+            shared(nBlocks, blockStart, bkt, nBuckets, offsets) \
+            if(nBlocks > 1)
+    for (int t = 0; t < nBlocks; t++) {
+        int *counts = &offsets[static_cast<size_t>(t) * nBuckets];
+        for (int i = blockStart(t); i < blockStart(t + 1); i++)
+            counts[bkt[i]]++;
+    }
+
+    int sum = 0;
+    for (int b = 0; b < nBuckets; b++)
+        for (int t = 0; t < nBlocks; t++) {
+            int &offset = offsets[static_cast<size_t>(t) * nBuckets + b];
+            const int count = offset;
+            offset = sum;
+            sum += count;
+        }
+
+    #pragma omp parallel for default(none) \
+            shared(nBlocks, blockStart, bkt, nBuckets, offsets, sortedIdx) \
+            if(nBlocks > 1)
+    for (int t = 0; t < nBlocks; t++) {
+        int *next = &offsets[static_cast<size_t>(t) * nBuckets];
+        for (int i = blockStart(t); i < blockStart(t + 1); i++)
+            sortedIdx[i] = next[bkt[i]]++;
+    }
+}
+
+/**
+ * Like stableScatter, but short segments are instead sorted by bucket with a
+ * sorting network, which gives the same positions (ties are broken by index)
+ * without allocating and scanning per-bucket counts.
+ */
+void bucketScatter(const int *bkt, int nPixels, int nBuckets, int *sortedIdx) {
+    // bucket ids below 2^24 are exact as floats
+    if (nPixels <= kernels::MAX_NETWORK_SORT && nBuckets <= (1 << 24)) {
+        float keys[kernels::MAX_NETWORK_SORT];
+        int32_t order[kernels::MAX_NETWORK_SORT];
+        for (int i = 0; i < nPixels; i++)
+            keys[i] = static_cast<float>(bkt[i]);
+        kernels::argsortSmall(keys, nPixels, order);
+        for (int r = 0; r < nPixels; r++)
+            sortedIdx[order[r]] = r;
+        return;
+    }
+
+    stableScatter(bkt, nPixels, nBuckets, sortedIdx);
+}
+
+/**
+ * Determines whether mixer swaps a subset of the channels of a pair of
+ * pixels and leaves the other channels in place (e.g. Map::swap).
+ * @return Whether each channel is swapped, if mixer is a channel swap, and
+ *   std::nullopt otherwise.
+ */
+std::optional<std::vector<bool>> swappedChannels(const Map &mixer,
+                                                 int depth) {
+    const auto sel = mixer.selection();
+    if (!sel || sel->size() != static_cast<size_t>(2 * depth))
+        return {};
+
+    std::vector<bool> swapped(depth);
+    for (int c = 0; c < depth; c++) {
+        swapped[c] = (*sel)[c] == depth + c;
+        if ((*sel)[c] != (swapped[c] ? depth + c : c)
+            || (*sel)[depth + c] != (swapped[c] ? c : depth + c))
+            return {};
+    }
+    return swapped;
+}
+
+/**
+ * Returns the sort keys of the pixels in pixels: a copy of keys if keys are
+ * given (i.e. precomputed, see Image::project), and otherwise the
+ * projection of each pixel.
+ */
+std::unique_ptr<float[]> sortKeys(const SegmentPixels &pixels,
+                                  const Map &project, const float *keys) {
+    const int nPixels = pixels.size();
+    std::unique_ptr<float[]> result(new float[nPixels]);
+    if (keys)
+        std::copy_n(keys, nPixels, result.get());
+    else
+        projectAll(pixels, project, result.get());
+    return result;
+}
+
+/**
+ * A pixel mixer: a Map from R^2d to R^2d applied to pairs of pixels.
+ * Mixers that only select channels of the pair (e.g. Map::swap) are applied
+ * by copying channels directly rather than by invoking the Map, and mixers
+ * that swap whole pixels by copying whole pixels.
+ */
+class Mixer {
+public:
+    explicit Mixer(Map mix)
+      : mix(std::move(mix)),
+        depth(this->mix.inDim / 2),
+        selection(this->mix.selection()),
+        wholeSwap(false) {
+        if (!selection)
+            return;
+
+        wholeSwap = true;
+        for (int c = 0; c < 2 * depth; c++)
+            wholeSwap &= (*selection)[c] == (c + depth) % (2 * depth);
+    }
+
+    /**
+     * Mixes n pairs of pixels in place: the kth pair is (a[k], b[k]).
+     * @param n At most BATCH_SIZE.
+     * @param writeBoth If false, only the first pixel of each pair (i.e. the
+     *   first d elements of the mixer's output) is written.
+     */
+    void operator()(float *const *a, float *const *b,
+                    int n, bool writeBoth) const {
+        if (wholeSwap) {
+            for (int k = 0; k < n; k++)
+                if (writeBoth)
+                    std::swap_ranges(a[k], a[k] + depth, b[k]);
+                else
+                    std::copy_n(b[k], depth, a[k]);
+            return;
+        }
+
+        const int pairDepth = 2 * depth;
+        float inPx[n * pairDepth];
+        for (int k = 0; k < n; k++) {
+            std::copy_n(a[k], depth, &inPx[k * pairDepth]);
+            std::copy_n(b[k], depth, &inPx[k * pairDepth + depth]);
+        }
+
+        if (selection) {
+            const int32_t *sel = selection->data();
+            for (int k = 0; k < n; k++) {
+                const float *pair = &inPx[k * pairDepth];
+                for (int c = 0; c < depth; c++)
+                    a[k][c] = pair[sel[c]];
+                if (writeBoth)
+                    for (int c = 0; c < depth; c++)
+                        b[k][c] = pair[sel[depth + c]];
+            }
+            return;
+        }
+
+        float outPx[n * pairDepth];
+        mix(inPx, pairDepth, outPx, pairDepth, n);
+        for (int k = 0; k < n; k++) {
+            std::copy_n(&outPx[k * pairDepth], depth, a[k]);
+            if (writeBoth)
+                std::copy_n(&outPx[k * pairDepth + depth], depth, b[k]);
+        }
+    }
+
+private:
+    const Map mix;
+    const int depth;
+    /** The mixer's selection, if it only selects channels. */
+    const std::optional<std::vector<int32_t>> selection;
+    /** True if the mixer swaps the pixels of a pair. */
+    bool wholeSwap;
+};
+
+/**
+ * For each i, mixes skewed pixel i into the result pixel at index
+ * sortedIdx[i], keeping the first d elements of the mixer's output.
+ * Pixel pairs are mixed in batches so that the mixer is invoked once per
+ * batch rather than once per pixel.
+ * Note: sortedIdx must be a permutation.
+ */
+void mixAll(SegmentPixels &result, const SegmentPixels &skewed,
+            const int *sortedIdx, const Mixer &mix) {
+    const int nPixels = skewed.size();
+
+    #pragma omp parallel for default(none) \
+            shared(nPixels, result, skewed, sortedIdx, mix) \
+            if(nPixels > BATCH_SIZE)
+    for (int start = 0; start < nPixels; start += BATCH_SIZE) {
+        const int n = min(BATCH_SIZE, nPixels - start);
+        float *dst[BATCH_SIZE];
+        float *src[BATCH_SIZE];
+        for (int i = 0; i < n; i++) {
+            dst[i] = result.px(sortedIdx[start + i]);
+            // only the first pixel of each pair is written
+            src[i] = const_cast<float *>(skewed.px(start + i));
+        }
+
+        mix(dst, src, n, false);
+    }
+}
+
+/**
+ * Copies the pixels of src, in order, to the pixels of out.
+ * Note: src and out must not alias.
+ */
+void copyViewed(const SegmentPixels &src, SegmentPixels &out) {
+    const int nPixels = src.size();
+    const int nChannels = src.depth();
+
+    #pragma omp parallel for default(none) \
+            shared(nPixels, nChannels, src, out) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPixels; i++)
+        std::copy_n(src.px(i), nChannels, out.px(i));
+}
+
+/**
+ * Returns a copy of the pixels in the view of pixels, in a new contiguous
+ * backing array of pixels.size() pixels. Unlike SegmentPixels::deepCopy,
+ * pixels of the backing array outside of the view are not copied.
+ */
+SegmentPixels compactCopy(const SegmentPixels &pixels) {
+    SegmentPixels copy(pixels.size(), pixels.depth());
+    copyViewed(pixels, copy);
+    return copy;
+}
+
+/**
+ * Returns pixels if they are unaffected by writes to out, and otherwise a
+ * compact copy of them.
+ */
+SegmentPixels unaliased(const SegmentPixels &pixels, const SegmentPixels &out) {
+    return pixels.aliases(out) ? compactCopy(pixels) : pixels;
+}
+
+/**
+ * Copies the pixels of src to out, unless they are already the same pixels
+ * (i.e. views of the same pixels of the same backing array).
+ */
+void copyPixels(const SegmentPixels &src, SegmentPixels &out) {
+    if (src.aliases(out) && src._getView() == out._getView())
+        return;
+
+    // writing to out may overwrite pixels of src that have yet to be copied
+    copyViewed(unaliased(src, out), out);
+}
+
 class Sorter::SorterImpl {
 public:
     virtual ~SorterImpl() = default;
 
-    virtual SegmentPixels operator()(
-            const SegmentPixels& base,
-            const SegmentPixels& skewed) const = 0;
+    /**
+     * Sorts the skewed pixels into the base pixels, writing the ith pixel of
+     * the result to out.px(i).
+     * out may alias base and/or skewed (see SegmentPixels::aliases); in
+     * particular, when out and base are the same pixels, they are sorted in
+     * place.
+     * @param keys Precomputed sort keys of the pixels that this Sorter
+     *   orders, or nullptr if they should be computed with this Sorter's
+     *   projection.
+     * @param out Has the same size() and depth() as base.
+     */
+    virtual void operator()(const SegmentPixels &base,
+                            const SegmentPixels &skewed,
+                            const float *keys,
+                            SegmentPixels &out) const = 0;
+
+    /**
+     * Computes the arrangement of the skewed pixels that this Sorter
+     * produces, as if its mixer swapped whole pixels: the skewed pixel at
+     * index perm[j] is placed at index j.
+     * @param keys As for operator().
+     * @param perm An array of base.size() ints.
+     */
+    virtual void permutation(const SegmentPixels &base,
+                             const SegmentPixels &skewed,
+                             const float *keys,
+                             int *perm) const = 0;
 };
 
-class BucketSort : public Sorter::SorterImpl {
+/**
+ * A Sorter that moves each skewed pixel directly to its destination in the
+ * result, and mixes it with the base pixel there.
+ */
+class ScatterSorter : public Sorter::SorterImpl {
+public:
+    explicit ScatterSorter(Map pixelMixer) : mixPixels(std::move(pixelMixer)) {}
+
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const final {
+        const std::unique_ptr<int[]> sortedIdx(new int[base.size()]);
+        sortedIndices(base, skewed, keys, sortedIdx.get());
+
+        const SegmentPixels src = unaliased(skewed, out);
+        copyPixels(base, out);
+        mixAll(out, src, sortedIdx.get(), mixPixels);
+    }
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const final {
+        const int nPixels = base.size();
+        const std::unique_ptr<int[]> sortedIdx(new int[nPixels]);
+        sortedIndices(base, skewed, keys, sortedIdx.get());
+
+        #pragma omp parallel for default(none) \
+                shared(nPixels, sortedIdx, perm) \
+                if(nPixels >= MIN_PARALLEL_PIXELS)
+        for (int i = 0; i < nPixels; i++)
+            perm[sortedIdx[i]] = i;
+    }
+
+protected:
+    const Mixer mixPixels;
+
+    /**
+     * Sets sortedIdx[i] to the index that skewed pixel i is moved to.
+     * sortedIdx must be a permutation.
+     */
+    virtual void sortedIndices(const SegmentPixels &base,
+                               const SegmentPixels &skewed,
+                               const float *keys,
+                               int *sortedIdx) const = 0;
+};
+
+class BucketSort : public ScatterSorter {
     const Map projectPixel;
-    const Map mixPixels;
     const int32_t nBuckets;
+    /** If true, buckets hold equal numbers of pixels (see quantileBuckets). */
+    const bool adaptive;
 
 public:
     BucketSort(const Map& pixelProjection,
                const Map& pixelMixer,
-               int32_t nBuckets)
-      : projectPixel(pixelProjection),
-        mixPixels(pixelMixer),
-        nBuckets(nBuckets){}
+               int32_t nBuckets,
+               bool adaptive = false)
+      : ScatterSorter(pixelMixer),
+        projectPixel(pixelProjection),
+        nBuckets(nBuckets),
+        adaptive(adaptive) {}
 
     ~BucketSort() override = default;
 
-    SegmentPixels operator()(
-            const SegmentPixels& base,
-            const SegmentPixels& skewed) const override;
+protected:
+    void sortedIndices(const SegmentPixels &base,
+                       const SegmentPixels &skewed,
+                       const float *keys,
+                       int *sortedIdx) const override;
 };
 
-int bucket(const float *pixel, const Map& projectPixel, int nBuckets) {
-    float pxProj;
-    projectPixel(pixel, &pxProj);
-
+int bucket(float pxProj, int nBuckets) {
     double const step = 1.0 / static_cast<double>(nBuckets);
 
     auto n_steps = static_cast<int>(floor(pxProj / step));
@@ -49,68 +460,264 @@ int bucket(const float *pixel, const Map& projectPixel, int nBuckets) {
     return bucket;
 }
 
-SegmentPixels bucketSort(const SegmentPixels &base,
-                         const SegmentPixels &skewed,
-                         const Map& projectPixel,
-                         const Map& mixPixels,
-                         int32_t nBuckets) {
-    const int nPixels = base.size();
-    const int nChannels = base.depth();
+/**
+ * Sets sortedIdx[i] to the position of the ith key when the keys are stably
+ * sorted by bucket (see stableScatter).
+ */
+void bucketIndices(const float *proj, int nPixels, int nBuckets,
+                   int *sortedIdx) {
+    const std::unique_ptr<int[]> bkt(new int[nPixels]);
+    #pragma omp parallel for default(none) \
+            shared(nPixels, proj, bkt, nBuckets) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPixels; i++)
+        bkt[i] = bucket(proj[i], nBuckets);
 
-    int bkt[nPixels];
-    int counts[nBuckets];
-#pragma omp simd
-    for (int i = 0; i < nBuckets; i++)
-        counts[i] = 0;
+    // Pixels in the same bucket keep their original relative order, so the
+    // result is deterministic.
+    bucketScatter(bkt.get(), nPixels, nBuckets, sortedIdx);
+}
 
-#pragma omp parallel for default(none) \
-            shared(nPixels, skewed, bkt, nBuckets, projectPixel) \
-            reduction(+:counts[:nBuckets])
+/**
+ * Returns the upper boundaries of the first nBuckets - 1 of nBuckets buckets
+ * that each hold about the same number of keys, estimated from the quantiles
+ * of an evenly strided sample of the keys.
+ * Boundaries are repeated when many keys are equal, which leaves some
+ * buckets empty.
+ */
+std::vector<float> quantileBuckets(const float *proj, int nPixels,
+                                   int nBuckets) {
+    const int nSamples = min(
+            nPixels,
+            max(MIN_QUANTILE_SAMPLES, QUANTILE_SAMPLES_PER_BUCKET * nBuckets));
+    std::vector<float> sample(nSamples);
+    for (int j = 0; j < nSamples; j++)
+        sample[j] = proj[static_cast<long>(j) * nPixels / nSamples];
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<float> bounds(max(nBuckets - 1, 0));
+    for (int b = 0; b < nBuckets - 1; b++)
+        bounds[b] = sample[static_cast<long>(b + 1) * nSamples / nBuckets];
+    return bounds;
+}
+
+/**
+ * Like bucketIndices, but with buckets of (about) equal population rather
+ * than of equal width, so that keys concentrated in a narrow range are still
+ * spread over all buckets.
+ */
+void quantileBucketIndices(const float *proj, int nPixels, int nBuckets,
+                           int *sortedIdx) {
+    if (nPixels == 0)
+        return;
+
+    const auto bounds = quantileBuckets(proj, nPixels, nBuckets);
+
+    const std::unique_ptr<int[]> bkt(new int[nPixels]);
+    #pragma omp parallel for default(none) \
+            shared(nPixels, proj, bkt, bounds) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPixels; i++)
+        bkt[i] = static_cast<int>(
+                std::upper_bound(bounds.begin(), bounds.end(), proj[i])
+                - bounds.begin());
+
+    stableScatter(bkt.get(), nPixels, nBuckets, sortedIdx);
+}
+
+void BucketSort::sortedIndices(const SegmentPixels &,
+                               const SegmentPixels &skewed,
+                               const float *keys,
+                               int *sortedIdx) const {
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+    if (adaptive)
+        quantileBucketIndices(proj.get(), skewed.size(), nBuckets, sortedIdx);
+    else
+        bucketIndices(proj.get(), skewed.size(), nBuckets, sortedIdx);
+}
+
+class RadixSort : public ScatterSorter {
+    const Map projectPixel;
+
+public:
+    RadixSort(Map pixelProjection, Map pixelMixer)
+      : ScatterSorter(std::move(pixelMixer)),
+        projectPixel(std::move(pixelProjection)) {}
+
+    ~RadixSort() override = default;
+
+protected:
+    void sortedIndices(const SegmentPixels &base,
+                       const SegmentPixels &skewed,
+                       const float *keys,
+                       int *sortedIdx) const override;
+};
+
+/**
+ * Stably sorts the indices [0, nPixels) by their keys with an LSD radix sort
+ * over 8-bit digits, and sets sortedIdx[i] to the position of index i in
+ * the sorted order.
+ * Each pass is a stableScatter of the pixels by one digit. Passes over
+ * digits that are equal for every key are skipped.
+ * Short segments are instead sorted with a sorting network, which gives the
+ * same order without allocating per-pass buffers.
+ */
+void radixSort(const float *proj, int nPixels, int *sortedIdx) {
+    constexpr int RADIX_BITS = 8;
+    constexpr int RADIX = 1 << RADIX_BITS;
+
+    if (nPixels <= kernels::MAX_NETWORK_SORT) {
+        int32_t order[kernels::MAX_NETWORK_SORT];
+        kernels::argsortSmall(proj, nPixels, order);
+        for (int r = 0; r < nPixels; r++)
+            sortedIdx[order[r]] = r;
+        return;
+    }
+
+    std::vector<uint32_t> key(nPixels), nextKey(nPixels);
+    std::vector<int> idx(nPixels), nextIdx(nPixels);
+    std::vector<int> digit(nPixels), pos(nPixels);
+
+    uint32_t anyBits = 0, allBits = ~0u;
+    #pragma omp parallel for default(none) shared(nPixels, proj, key, idx) \
+            reduction(|:anyBits) reduction(&:allBits) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
     for (int i = 0; i < nPixels; i++) {
-        bkt[i] = bucket(skewed.px(i), projectPixel, nBuckets);
-        counts[bkt[i]]++;
+        key[i] = kernels::orderedBits(proj[i]);
+        idx[i] = i;
+        anyBits |= key[i];
+        allBits &= key[i];
     }
 
-    // Compute index of first pixel in each bucket
-    int indices[nBuckets];
-    for (int i = 0; i < nBuckets; i++)
-        indices[i] = 0;
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        if (((anyBits ^ allBits) >> shift) % RADIX == 0)
+            continue;
 
-    for (int b = 1; b < nBuckets; b++)
-        indices[b] = counts[b - 1] + indices[b - 1];
+        #pragma omp parallel for default(none) \
+                shared(nPixels, key, digit, shift) \
+                if(nPixels >= MIN_PARALLEL_PIXELS)
+        for (int i = 0; i < nPixels; i++)
+            digit[i] = static_cast<int>((key[i] >> shift) % RADIX);
 
-    SegmentPixels result = base.deepCopy();
-    float inPx[2 * nChannels];
-    float outPx[2 * nChannels];
-    #pragma omp parallel for default(none) private(inPx, outPx) \
-            shared(nPixels, nChannels, indices, bkt, result, skewed, mixPixels)
-    for (int iBase = 0; iBase < nPixels; iBase++) {
-        int bkt_iBase = bkt[iBase];
-        int iSorted;
+        stableScatter(digit.data(), nPixels, RADIX, pos.data());
 
-        #pragma omp atomic capture
-        iSorted = indices[bkt_iBase]++;
+        #pragma omp parallel for default(none) \
+                shared(nPixels, key, idx, nextKey, nextIdx, pos) \
+                if(nPixels >= MIN_PARALLEL_PIXELS)
+        for (int i = 0; i < nPixels; i++) {
+            nextKey[pos[i]] = key[i];
+            nextIdx[pos[i]] = idx[i];
+        }
+        key.swap(nextKey);
+        idx.swap(nextIdx);
+    }
 
-        std::copy_n(result.px(iSorted), nChannels, inPx);
-        std::copy_n(skewed.px(iBase), nChannels, &inPx[nChannels]);
+    #pragma omp parallel for default(none) shared(nPixels, idx, sortedIdx) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int r = 0; r < nPixels; r++)
+        sortedIdx[idx[r]] = r;
+}
 
-        mixPixels(inPx, outPx);
+void RadixSort::sortedIndices(const SegmentPixels &,
+                              const SegmentPixels &skewed,
+                              const float *keys,
+                              int *sortedIdx) const {
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+    radixSort(proj.get(), skewed.size(), sortedIdx);
+}
 
-        std::copy_n(outPx, nChannels, result.px(iSorted));
-    }
+class Windowed : public ScatterSorter {
+    const Map projectPixel;
+    const int radius;
 
-    return result;
+public:
+    Windowed(Map pixelProjection, Map pixelMixer, int radius)
+      : ScatterSorter(std::move(pixelMixer)),
+        projectPixel(std::move(pixelProjection)),
+        radius(max(radius, 0)) {}
+
+    ~Windowed() override = default;
+
+protected:
+    void sortedIndices(const SegmentPixels &base,
+                       const SegmentPixels &skewed,
+                       const float *keys,
+                       int *sortedIdx) const override;
+};
+
+/**
+ * Stably sorts the indices in each block of blockLen consecutive elements of
+ * order by their keys. The first block starts at offset - blockLen (and is
+ * cut off at 0); each block is sorted independently, in parallel.
+ */
+void sortBlocks(const float *proj, int *order, int nPixels,
+                int offset, int blockLen) {
+    const long first = offset - blockLen;
+    const long nBlocks = (nPixels - first + blockLen - 1) / blockLen;
+
+    #pragma omp parallel for default(none) schedule(dynamic, 16) \
+            shared(proj, order, nPixels, first, blockLen, nBlocks) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (long b = 0; b < nBlocks; b++) {
+        const long lo = max(first + b * blockLen, 0L);
+        const long hi = min(first + (b + 1) * blockLen,
+                            static_cast<long>(nPixels));
+        if (blockLen > kernels::MAX_NETWORK_SORT) {
+            // keys are compared as by argsortSmall
+            std::stable_sort(&order[lo], &order[hi], [=](int i, int j) {
+                return kernels::orderedBits(proj[i])
+                       < kernels::orderedBits(proj[j]);
+            });
+            continue;
+        }
+
+        // short blocks are sorted with a sorting network
+        const int n = static_cast<int>(hi - lo);
+        float blockKeys[kernels::MAX_NETWORK_SORT];
+        int32_t blockOrder[kernels::MAX_NETWORK_SORT];
+        int32_t rank[kernels::MAX_NETWORK_SORT];
+        for (int k = 0; k < n; k++) {
+            blockOrder[k] = order[lo + k];
+            blockKeys[k] = proj[blockOrder[k]];
+        }
+        kernels::argsortSmall(blockKeys, n, rank);
+        for (int r = 0; r < n; r++)
+            order[lo + r] = blockOrder[rank[r]];
+    }
 }
 
-SegmentPixels BucketSort::operator()(
-        const SegmentPixels &base,
-        const SegmentPixels &skewed) const {
-    return bucketSort(base, skewed, projectPixel, mixPixels, nBuckets);
+void Windowed::sortedIndices(const SegmentPixels &,
+                             const SegmentPixels &skewed,
+                             const float *keys,
+                             int *sortedIdx) const {
+    const int nPixels = skewed.size();
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+
+    // order[j]: the index of the pixel that is moved to j
+    const std::unique_ptr<int[]> order(new int[nPixels]);
+    std::iota(order.get(), order.get() + nPixels, 0);
+
+    // Sorting blocks of blockLen pixels moves each pixel at most
+    // blockLen - 1 positions. A second pass over blocks that straddle the
+    // boundaries of the first lets pixels cross them, and the two passes
+    // together move each pixel at most radius positions.
+    if (radius < 2) {
+        sortBlocks(proj.get(), order.get(), nPixels, 0, radius + 1);
+    } else {
+        const int blockLen = radius / 2 + 1;
+        sortBlocks(proj.get(), order.get(), nPixels, 0, blockLen);
+        sortBlocks(proj.get(), order.get(), nPixels, blockLen / 2, blockLen);
+    }
+
+    #pragma omp parallel for default(none) shared(nPixels, order, sortedIdx) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int j = 0; j < nPixels; j++)
+        sortedIdx[order[j]] = j;
 }
 
 class Heapify : public Sorter::SorterImpl {
     const Map project;
-    const Map mix;
+    const Mixer mix;
 
 public:
     Heapify(Map  pixelProjection,
@@ -120,114 +727,244 @@ public:
 
     ~Heapify() override = default;
 
-    SegmentPixels operator()(
-            const SegmentPixels &base,
-            const SegmentPixels &skewed) const override;
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const override;
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const override;
 
 private:
     static inline long left_child(long idx) { return (2 * idx) + 1; };
     static inline long right_child(long idx) { return (2 * idx) + 2; };
+
+    /**
+     * Returns the index of the "largest" out of the root and its left and
+     * right children (if they exist).
+     */
+    static inline long largest(const float *proj, long root, long nPixels) {
+        auto left = left_child(root);
+        auto right = right_child(root);
+
+        float rootProj = proj[root];
+        float leftProj = left < nPixels ? proj[left] : -INFINITY;
+        float rightProj = right < nPixels ? proj[right] : -INFINITY;
+
+        return rootProj > leftProj ? (rootProj > rightProj ? root : right)
+                                   : (leftProj > rightProj ? left : right);
+    }
+
+    /**
+     * Performs a bubble-down pass for the element at index root of the heap.
+     * Only the subtree rooted at root is read or written.
+     * @param proj The projection of each pixel in result; kept in sync.
+     */
+    void siftDown(SegmentPixels &result, float *proj,
+                  long root, long nPixels) const;
 };
 
-SegmentPixels Heapify::operator()(
-        const SegmentPixels &base,
-        const SegmentPixels &skewed) const {
-    long nPixels = base.size();
-    long nChannels = base.depth();
+void Heapify::siftDown(SegmentPixels &result, float *proj,
+                       long root, long nPixels) const {
+    do {
+        // Use our pixel projection to determine the "largest" pixel out of
+        // the root and its left and right children (if they exist).
+        auto largest = Heapify::largest(proj, root, nPixels);
+
+        // If the largest of the root and its left and right children is
+        // not the root, then we need to do a swap (mixPixels in this context)
+        // and continue bubbling down.
+        if (largest != root) {
+            float *rootPx = result.px(root);
+            float *largestPx = result.px(largest);
+            mix(&rootPx, &largestPx, 1, true);
+
+            // keep the keys of the mixed pixels in sync
+            project(result.px(root), &proj[root]);
+            project(result.px(largest), &proj[largest]);
+
+            root = largest;
+        }
+        // If the largest of the root and its left and right children is
+        // the root, then we are done bubbling down this element.
+        else break;
 
-    SegmentPixels result = skewed.deepCopy();
-    for (long i = (nPixels / 2) - 1; i >= 0; i--) {
-        // Perform bubble-down pass for a single element of the heap.
-        // Note: the outer if statements in the loop are just bounds checks
-        //       (i.e. "Is there a left/right child?").
-        auto root = i;
-        do {
-            auto left = left_child(root);
-            auto right = right_child(root);
-
-            // Use our pixel projection to determine the "largest" pixel out of
-            // the root and its left and right children (if they exist).
-            float rootProj;
-            project(result.px(root), &rootProj);
-
-            float leftProj = -INFINITY;
-            if (left < nPixels)
-                project(result.px(left), &leftProj);
-
-            float rightProj = -INFINITY;
-            if (right < nPixels)
-                project(result.px(right), &rightProj);
-
-            auto largest = rootProj > leftProj ? (rootProj > rightProj ? root
-                                                                       : right)
-                                               : (leftProj > rightProj ? left
-                                                                       : right);
-
-            // If the largest of the root and its left and right children is
-            // not the root, then we need to do a swap (mixPixels in this context)
-            // and continue bubbling down.
-            float inPx[2 * nChannels];
-            float outPx[2 * nChannels];
-            if (largest != root) {
-                std::copy_n(result.px(root), nChannels, inPx);
-                std::copy_n(result.px(largest), nChannels, &inPx[nChannels]);
-
-                mix(inPx, outPx);
-
-                std::copy_n(outPx, nChannels, result.px(root));
-                std::copy_n(&outPx[nChannels], nChannels, result.px(largest));
-
-                root = largest;
-            }
-            // If the largest of the root and its left and right children is
-            // the root, then we are done bubbling down this element.
-            else break;
+    } while (root < nPixels);
+}
 
-        } while (root < nPixels);
+void Heapify::operator()(const SegmentPixels &base,
+                         const SegmentPixels &skewed,
+                         const float *keys,
+                         SegmentPixels &out) const {
+    const long nPixels = base.size();
+
+    // the heap is built in place in out
+    copyPixels(skewed, out);
+
+    // Keys are computed once up front, and only the two pixels written back
+    // by each mix are re-projected, so that each pixel is not re-projected
+    // at every level of every bubble-down pass.
+    const auto proj = sortKeys(out, project, keys);
+
+    // The heap is built bottom-up, one level at a time. The subtrees rooted
+    // at the nodes of a level are disjoint, so their bubble-down passes are
+    // independent and can run in parallel; since every level is finished
+    // before the level above it starts, the result is the same as that of
+    // bubbling down nodes serially in reverse index order.
+    const long lastParent = (nPixels / 2) - 1;
+    long levelStart = 0;
+    while (2 * levelStart + 1 <= lastParent)
+        levelStart = 2 * levelStart + 1;
+
+    for (; levelStart >= 0; levelStart = (levelStart - 1) / 2) {
+        const long levelEnd = min(2 * levelStart, lastParent);
+
+        #pragma omp parallel for default(none) schedule(dynamic, 64) \
+                shared(out, proj, nPixels, levelStart, levelEnd) \
+                if(levelEnd - levelStart >= MIN_PARALLEL_HEAP_LEVEL)
+        for (long i = levelEnd; i >= levelStart; i--)
+            siftDown(out, proj.get(), i, nPixels);
+
+        if (levelStart == 0)
+            break;
     }
+}
 
-    return result;
+void Heapify::permutation(const SegmentPixels &base,
+                          const SegmentPixels &skewed,
+                          const float *keys,
+                          int *perm) const {
+    const long nPixels = base.size();
+    const auto proj = sortKeys(skewed, project, keys);
+    std::iota(perm, perm + nPixels, 0);
+
+    // keys move with their pixels, so no pixels need to be re-projected
+    for (long i = (nPixels / 2) - 1; i >= 0; i--) {
+        for (auto root = i; root < nPixels;) {
+            auto largest = Heapify::largest(proj.get(), root, nPixels);
+            if (largest == root)
+                break;
+
+            std::swap(proj[root], proj[largest]);
+            std::swap(perm[root], perm[largest]);
+            root = largest;
+        }
+    }
 }
 
 class Bubble : public Sorter::SorterImpl {
     const Map project;
-    const Map mix;
+    const Mixer mix;
     const double fraction;
+    /** Set if mix is a channel swap (see swappedChannels). */
+    const std::optional<std::vector<bool>> swapped;
 
 public:
     Bubble(Map  pixelProjection,
-           Map  pixelMixer,
+           const Map &pixelMixer,
            float fraction)
     : project(std::move(pixelProjection)),
-      mix(std::move(pixelMixer)),
-      fraction(clamp<float>(fraction, 0.0, 1.0)) {}
+      mix(pixelMixer),
+      fraction(clamp<float>(fraction, 0.0, 1.0)),
+      swapped(swappedChannels(pixelMixer, project.inDim)) {}
 
     ~Bubble() override = default;
 
-    SegmentPixels operator()(
-            const SegmentPixels &base,
-            const SegmentPixels &skewed) const override;
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const override;
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const override;
+
+private:
+    /** Returns the number of passes to perform on nPixels pixels. */
+    [[nodiscard]]
+    int passes(int nPixels) const {
+        // operator() always performs at least one pass
+        return max(static_cast<int>(fraction * nPixels), 1);
+    }
+
+    void emulatePasses(const SegmentPixels &skewed, const float *proj,
+                       int passes, SegmentPixels &out) const;
 };
 
-SegmentPixels Bubble::operator()(
-        const SegmentPixels &base,
-        const SegmentPixels &skewed) const {
+/**
+ * Computes the result of k bubble-sort passes over the first nPixels keys
+ * without performing them, by moving the largest keys seen so far along in
+ * a min-heap of size k: one pass carries the largest key seen so far to the
+ * right, and k passes carry the k largest.
+ * Ties are broken by index, as bubble-sort is stable.
+ * @param order Set to the permutation applied by the passes, i.e. the key
+ *   at position i after the passes is the key at position order[i] before.
+ */
+void bubblePasses(const float *proj, int nPixels, int k, int *order) {
+    using Key = std::pair<float, int>;
+    std::priority_queue<Key, std::vector<Key>, std::greater<>> carried;
+
+    int out = 0;
+    for (int i = 0; i < nPixels; i++) {
+        carried.emplace(proj[i], i);
+        if (carried.size() > static_cast<size_t>(k)) {
+            order[out++] = carried.top().second;
+            carried.pop();
+        }
+    }
+    for (; !carried.empty(); carried.pop())
+        order[out++] = carried.top().second;
+}
+
+/**
+ * Produces the same result as performing the given number of passes with a
+ * channel-swap mixer, in O(n log(passes)) time: swapped channels follow
+ * their keys, and the other channels stay in place.
+ */
+void Bubble::emulatePasses(const SegmentPixels &skewed, const float *proj,
+                           int passes, SegmentPixels &out) const {
+    const int nPixels = skewed.size();
+    const int nChannels = skewed.depth();
+
+    // the passes performed by operator() never reach the last pixel
+    const int nSorted = max(nPixels - 1, 0);
+    const std::unique_ptr<int[]> order(new int[nSorted]);
+    bubblePasses(proj, nSorted, passes, order.get());
+
+    const SegmentPixels from = unaliased(skewed, out);
+    copyPixels(from, out);
+    #pragma omp parallel for default(none) \
+            shared(nSorted, nChannels, order, from, out) \
+            if(nSorted >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nSorted; i++) {
+        const float *src = from.px(order[i]);
+        float *dst = out.px(i);
+        for (int c = 0; c < nChannels; c++)
+            if ((*swapped)[c])
+                dst[c] = src[c];
+    }
+}
+
+void Bubble::operator()(const SegmentPixels &base,
+                        const SegmentPixels &skewed,
+                        const float *keys,
+                        SegmentPixels &out) const {
     auto nPixels = base.size();
-    auto nChannels = base.depth();
     const int maxPasses = fraction * static_cast<double>(nPixels);
 
     // optimization to avoid quadratic calls to potentially expensive
     // projection routines
-    const std::unique_ptr<float[]> proj(new float[nPixels]);
-    #pragma omp parallel for default(none) shared(nPixels, base, proj)
-    for (int i = 0; i < nPixels; i++)
-        project(base.px(i), &(proj[i]));
+    const auto proj = sortKeys(base, project, keys);
+
+    if (swapped)
+        return emulatePasses(skewed, proj.get(), passes(nPixels), out);
 
-    SegmentPixels result = skewed.deepCopy();
+    copyPixels(skewed, out);
     int32_t passes = 0;
     int32_t n = nPixels - 1;
-    float inPx[2 * nChannels];
-    float outPx[2 * nChannels];
     do {
         int32_t newN = 0;
         for (int i = 1; i < n; i++) {
@@ -237,37 +974,317 @@ SegmentPixels Bubble::operator()(
                 proj[i - 1] = lo;
                 newN = i;
 
-                std::copy_n(result.px(i - 1), 2 * nChannels, inPx);
-                mix(inPx, outPx);
-                std::copy_n(outPx, 2 * nChannels, result.px(i - 1));
+                float *loPx = out.px(i - 1);
+                float *hiPx = out.px(i);
+                mix(&loPx, &hiPx, 1, true);
             }
         }
         n = newN;
         passes++;
     } while (n > 1 && passes < maxPasses);
+}
 
-    return result;
+void Bubble::permutation(const SegmentPixels &base,
+                         const SegmentPixels &,
+                         const float *keys,
+                         int *perm) const {
+    const int nPixels = base.size();
+    const auto proj = sortKeys(base, project, keys);
+
+    // the passes performed by operator() never reach the last pixel
+    const int nSorted = max(nPixels - 1, 0);
+    bubblePasses(proj.get(), nSorted, passes(nPixels), perm);
+    if (nPixels > 0)
+        perm[nSorted] = nSorted;
+}
+
+
+class OddEvenBubble : public Sorter::SorterImpl {
+    const Map project;
+    const Mixer mix;
+    const double fraction;
+
+public:
+    OddEvenBubble(Map pixelProjection, Map pixelMixer, double fraction)
+    : project(std::move(pixelProjection)),
+      mix(std::move(pixelMixer)),
+      fraction(clamp<double>(fraction, 0.0, 1.0)) {}
+
+    ~OddEvenBubble() override = default;
+
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const override;
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const override;
+};
+
+void OddEvenBubble::operator()(const SegmentPixels &base,
+                               const SegmentPixels &skewed,
+                               const float *keys,
+                               SegmentPixels &out) const {
+    const int nPixels = base.size();
+    const long maxPhases = std::ceil(fraction * static_cast<double>(nPixels));
+
+    const auto proj = sortKeys(base, project, keys);
+
+    copyPixels(skewed, out);
+
+    // Phase p compares (and, if out of order, mixes) the pairs (j, j + 1)
+    // with j = p mod 2. The pairs within a phase are disjoint, so they are
+    // compared in parallel, and the pairs to mix are gathered into batches.
+    // Two consecutive phases without a swap mean the pixels are sorted.
+    int quietPhases = 0;
+    for (long phase = 0; phase < maxPhases && quietPhases < 2; phase++) {
+        const int first = static_cast<int>(phase % 2);
+        const int nPairs = (nPixels - first) / 2;
+        int swaps = 0;
+
+        #pragma omp parallel for default(none) \
+                shared(first, nPairs, proj, out) \
+                reduction(+:swaps) if(nPairs >= MIN_PARALLEL_PHASE)
+        for (int start = 0; start < nPairs; start += BATCH_SIZE) {
+            float *lo[BATCH_SIZE];
+            float *hi[BATCH_SIZE];
+            int n = 0;
+            for (int p = start; p < min(start + BATCH_SIZE, nPairs); p++) {
+                const int j = first + 2 * p;
+                if (proj[j + 1] < proj[j]) {
+                    std::swap(proj[j], proj[j + 1]);
+                    lo[n] = out.px(j);
+                    hi[n++] = out.px(j + 1);
+                }
+            }
+            if (n == 0)
+                continue;
+
+            mix(lo, hi, n, true);
+            swaps += n;
+        }
+
+        quietPhases = swaps > 0 ? 0 : quietPhases + 1;
+    }
+}
+
+void OddEvenBubble::permutation(const SegmentPixels &base,
+                                const SegmentPixels &,
+                                const float *keys,
+                                int *perm) const {
+    const int nPixels = base.size();
+    const long maxPhases = std::ceil(fraction * static_cast<double>(nPixels));
+
+    const auto proj = sortKeys(base, project, keys);
+    std::iota(perm, perm + nPixels, 0);
+
+    int quietPhases = 0;
+    for (long phase = 0; phase < maxPhases && quietPhases < 2; phase++) {
+        const int first = static_cast<int>(phase % 2);
+        const int nPairs = (nPixels - first) / 2;
+        int swaps = 0;
+
+        #pragma omp parallel for default(none) shared(first, nPairs, proj, perm) \
+                reduction(+:swaps) if(nPairs >= MIN_PARALLEL_PHASE)
+        for (int p = 0; p < nPairs; p++) {
+            const int j = first + 2 * p;
+            if (proj[j + 1] < proj[j]) {
+                std::swap(proj[j], proj[j + 1]);
+                std::swap(perm[j], perm[j + 1]);
+                swaps++;
+            }
+        }
+
+        quietPhases = swaps > 0 ? 0 : quietPhases + 1;
+    }
 }
 
 
-struct PseudoBubble : public Sorter::SorterImpl {
+class MergeSort : public Sorter::SorterImpl {
+    const Map project;
+    const Mixer mix;
+    const int levels;
+
+public:
+    MergeSort(Map pixelProjection, Map pixelMixer, int levels)
+    : project(std::move(pixelProjection)),
+      mix(std::move(pixelMixer)),
+      levels(levels) {}
+
+    ~MergeSort() override = default;
+
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const override;
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const override;
+
+private:
+    /** Returns the number of merge levels to perform on nPixels pixels. */
+    [[nodiscard]]
+    int nLevels(int nPixels) const {
+        int full = 0;
+        while ((1L << full) < nPixels)
+            full++;
+        return levels < 0 ? full : min(levels, full);
+    }
+};
+
+/**
+ * Performs nLevels levels of a bottom-up merge sort of nPixels elements:
+ * level l merges the pairs of adjacent runs of 2^l elements, by calling
+ * mergeRuns(lo, mid, hi, l) for each pair of runs [lo, mid) and [mid, hi).
+ * The pairs of a level are disjoint, so they are merged in parallel. All
+ * merges of a level but the last have the same size, so they are split
+ * statically: low levels hold many cheap merges, for which dynamic
+ * scheduling would cost more than the merges themselves.
+ */
+template <class MergeRuns>
+void mergeLevels(int nPixels, int nLevels, const MergeRuns &mergeRuns) {
+    for (int level = 0; level < nLevels; level++) {
+        const long width = 1L << level;
+        const long nMerges = (nPixels + 2 * width - 1) / (2 * width);
+
+        #pragma omp parallel for default(none) schedule(static) \
+                shared(nPixels, level, width, nMerges, mergeRuns) \
+                if(nMerges > 1 && nPixels >= MIN_PARALLEL_MERGE)
+        for (long m = 0; m < nMerges; m++) {
+            const long lo = 2 * width * m;
+            const long mid = min(lo + width, static_cast<long>(nPixels));
+            const long hi = min(lo + 2 * width, static_cast<long>(nPixels));
+            mergeRuns(lo, mid, hi, level);
+        }
+    }
+}
+
+/**
+ * Stably merges the sorted runs [lo, mid) and [mid, hi) of srcKeys into
+ * [lo, hi) of dstKeys. Calls move(i, k) when the element at i is moved to
+ * k, and cross(i, j, k) when the head j of the second run is moved to k
+ * ahead of the head i of the first run.
+ */
+template <class Move, class Cross>
+void mergeRuns(const float *srcKeys, float *dstKeys,
+               long lo, long mid, long hi,
+               const Move &move, const Cross &cross) {
+    long i = lo, j = mid;
+    for (long k = lo; k < hi; k++) {
+        if (j < hi && (i == mid || srcKeys[j] < srcKeys[i])) {
+            if (i < mid)
+                cross(i, j, k);
+            else
+                move(j, k);
+            dstKeys[k] = srcKeys[j++];
+        } else {
+            move(i, k);
+            dstKeys[k] = srcKeys[i++];
+        }
+    }
+}
+
+void MergeSort::operator()(const SegmentPixels &base,
+                           const SegmentPixels &skewed,
+                           const float *keys,
+                           SegmentPixels &out) const {
+    const int nPixels = base.size();
+    const int nChannels = base.depth();
+    const int levels = nLevels(nPixels);
+
+    // Pixels and their keys are merged back and forth between two
+    // contiguous buffers.
+    std::unique_ptr<float[]> proj[2] = {sortKeys(skewed, project, keys),
+                                        std::make_unique<float[]>(nPixels)};
+    std::vector<float> px[2] = {std::vector<float>(nPixels * nChannels),
+                                std::vector<float>(nPixels * nChannels)};
+
+    #pragma omp parallel for default(none) \
+            shared(nPixels, nChannels, skewed, px) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPixels; i++)
+        std::copy_n(skewed.px(i), nChannels, &px[0][i * nChannels]);
+
+    mergeLevels(nPixels, levels, [&](long lo, long mid, long hi, int level) {
+        float *src = px[level % 2].data();
+        float *dst = px[1 - level % 2].data();
+
+        const auto move = [=](long i, long k) {
+            std::copy_n(&src[i * nChannels], nChannels, &dst[k * nChannels]);
+        };
+        // As in a bubble-sort swap, the pair is mixed in place; the first
+        // pixel of the result is moved ahead, and the second pixel replaces
+        // the head of the first run (and takes its key).
+        const auto cross = [=, this](long i, long j, long k) {
+            float *a = &src[i * nChannels];
+            float *b = &src[j * nChannels];
+            mix(&a, &b, 1, true);
+            std::copy_n(a, nChannels, &dst[k * nChannels]);
+            std::copy_n(b, nChannels, a);
+        };
+
+        mergeRuns(proj[level % 2].get(), proj[1 - level % 2].get(),
+                  lo, mid, hi, move, cross);
+    });
+
+    const float *result = px[levels % 2].data();
+    #pragma omp parallel for default(none) \
+            shared(nPixels, nChannels, result, out) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPixels; i++)
+        std::copy_n(&result[i * nChannels], nChannels, out.px(i));
+}
+
+void MergeSort::permutation(const SegmentPixels &base,
+                            const SegmentPixels &skewed,
+                            const float *keys,
+                            int *perm) const {
+    const int nPixels = base.size();
+    const int levels = nLevels(nPixels);
+
+    std::unique_ptr<float[]> proj[2] = {sortKeys(skewed, project, keys),
+                                        std::make_unique<float[]>(nPixels)};
+    std::vector<int> idx[2] = {std::vector<int>(nPixels),
+                               std::vector<int>(nPixels)};
+    std::iota(idx[0].begin(), idx[0].end(), 0);
+
+    mergeLevels(nPixels, levels, [&](long lo, long mid, long hi, int level) {
+        const int *src = idx[level % 2].data();
+        int *dst = idx[1 - level % 2].data();
+
+        const auto move = [=](long i, long k) { dst[k] = src[i]; };
+        const auto cross = [=](long, long j, long k) { dst[k] = src[j]; };
+        mergeRuns(proj[level % 2].get(), proj[1 - level % 2].get(),
+                  lo, mid, hi, move, cross);
+    });
+
+    std::copy(idx[levels % 2].begin(), idx[levels % 2].end(), perm);
+}
+
+
+struct PseudoBubble : public ScatterSorter {
     PseudoBubble(Map pixelProjection, Map pixelMixer,
                  double fraction, int maxBuckets)
-            : projectPixel(std::move(pixelProjection)),
-              mixPixels(std::move(pixelMixer)),
+            : ScatterSorter(std::move(pixelMixer)),
+              projectPixel(std::move(pixelProjection)),
               fraction(clamp<double>(fraction, 0.0, 1.0)),
               fineStep(1.0 / static_cast<float>(maxBuckets)),
               maxBuckets(maxBuckets) {}
 
     ~PseudoBubble() override = default;
 
-    SegmentPixels operator()(
-            const SegmentPixels &base,
-            const SegmentPixels &skewed) const override;
+protected:
+    void sortedIndices(const SegmentPixels &base,
+                       const SegmentPixels &skewed,
+                       const float *keys,
+                       int *sortedIdx) const override;
 
 private:
     Map projectPixel;
-    Map mixPixels;
     double fraction;
 
     int maxBuckets;
@@ -282,11 +1299,13 @@ inline int cmpAbsDist(int x, int a, int b) {
     return abs(x - a) - abs(x - b);
 }
 
-SegmentPixels PseudoBubble::operator()(
-        const SegmentPixels &base,
-        const SegmentPixels &skewed) const {
+void PseudoBubble::sortedIndices(const SegmentPixels &base,
+                                 const SegmentPixels &skewed,
+                                 const float *keys,
+                                 int *sortedIdx) const {
     int const nPx = base.size();
-    int const nCh = base.depth();
+
+    const auto proj = sortKeys(skewed, projectPixel, keys);
 
     std::unique_ptr<int[]> const initBkt(new int[nPx]);
     int initCounts[maxBuckets];
@@ -296,12 +1315,9 @@ SegmentPixels PseudoBubble::operator()(
 
     #pragma omp parallel for default(none) \
             reduction(+:initCounts[:maxBuckets]) \
-            shared(nPx, skewed, initBkt)
+            shared(nPx, proj, initBkt) if(nPx >= MIN_PARALLEL_PIXELS)
     for (int i = 0; i < nPx; i++) {
-        float pxProj;
-        projectPixel(skewed.px(i), &pxProj);
-
-        initBkt[i] = clamp(static_cast<int>(std::floor(pxProj / fineStep)),
+        initBkt[i] = clamp(static_cast<int>(std::floor(proj[i] / fineStep)),
                            0, maxBuckets - 1);
         initCounts[initBkt[i]]++;
     }
@@ -317,54 +1333,78 @@ SegmentPixels PseudoBubble::operator()(
         size += initCounts[minBkt];
     }
 
+    // pixels below minBkt share bucket 0
     const std::unique_ptr<int[]> bkt(new int[nPx]);
     const int nBkts = 1 + (maxBuckets - minBkt);
-    int bktCounts[nBkts];
-    #pragma omp simd
-    for (int i = 0; i < nBkts; i++)
-        bktCounts[i] = 0;
-
-    #pragma omp parallel for default(none) \
-            reduction(+:bktCounts[:nBkts]) \
-            shared(nPx, initBkt, bkt, minBkt, nBkts)
-    for (int i = 0; i < nPx; i++) {
-        int const bb = max(0, 1 + (initBkt[i] - minBkt));
-        bkt[i] = bb;
-        bktCounts[bb]++;
-    }
-
-    // Compute index of first pixel in each bucket
-    int bktStarts[nBkts];
-    bktStarts[0] = 0;
-    for (int b = 1; b < nBkts; b++)
-        bktStarts[b] = bktCounts[b - 1] + bktStarts[b - 1];
-
-
-    const std::unique_ptr<int[]> sortedIdx(new int[nPx]);
-    // unavoidable / non-parallelizable loop?
-    // want to preserve "unsorted" pixels' original order
-    for (int i = 0; i < nPx; i++) {
-        auto b = bkt[i];
-        sortedIdx[i] = bktStarts[b]++;
-    }
+    #pragma omp parallel for default(none) shared(nPx, initBkt, bkt, minBkt) \
+            if(nPx >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPx; i++)
+        bkt[i] = max(0, 1 + (initBkt[i] - minBkt));
 
-    SegmentPixels result = base.deepCopy();
-    float inPx[2 * nCh];
-    float outPx[2 * nCh];
-    #pragma omp parallel for default(none) private(inPx, outPx) \
-            shared(nPx, nCh, sortedIdx, result, skewed)
-    for (int iBase = 0; iBase < nPx; iBase++) {
-        int iSorted = sortedIdx[iBase];
+    // the scatter is stable, so "unsorted" pixels keep their original order
+    bucketScatter(bkt.get(), nPx, nBkts, sortedIdx);
+}
 
-        std::copy_n(result.px(iSorted), nCh, inPx);
-        std::copy_n(skewed.px(iBase), nCh, &inPx[nCh]);
+class PartialSort : public ScatterSorter {
+    const Map projectPixel;
+    const double fraction;
 
-        mixPixels(inPx, outPx);
+public:
+    PartialSort(Map pixelProjection, Map pixelMixer, double fraction)
+      : ScatterSorter(std::move(pixelMixer)),
+        projectPixel(std::move(pixelProjection)),
+        fraction(clamp<double>(fraction, 0.0, 1.0)) {}
+
+    ~PartialSort() override = default;
+
+protected:
+    void sortedIndices(const SegmentPixels &base,
+                       const SegmentPixels &skewed,
+                       const float *keys,
+                       int *sortedIdx) const override;
+};
 
-        std::copy_n(outPx, nCh, result.px(iSorted));
-    }
+void PartialSort::sortedIndices(const SegmentPixels &,
+                                const SegmentPixels &skewed,
+                                const float *keys,
+                                int *sortedIdx) const {
+    const int nPx = skewed.size();
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+    const int nSelected = min(
+            static_cast<int>(std::ceil(static_cast<double>(nPx) * fraction)),
+            nPx);
+    const int firstSelected = nPx - nSelected;
+
+    // Ties are broken by index, so that exactly nSelected pixels compare
+    // greater than or equal to the threshold.
+    const auto less = [&proj](int i, int j) {
+        return proj[i] < proj[j] || (proj[i] == proj[j] && i < j);
+    };
+
+    // Selects the nSelected largest pixels with introselect, in O(n), and
+    // then sorts only them, in O(k log k).
+    std::vector<int> idx(nPx);
+    std::iota(idx.begin(), idx.end(), 0);
+    if (nSelected > 0 && firstSelected > 0)
+        std::nth_element(idx.begin(), idx.begin() + firstSelected, idx.end(),
+                         less);
+    std::sort(idx.begin() + firstSelected, idx.end(), less);
+
+    // The other pixels keep their original order, in front of the selected
+    // pixels (bucket 1).
+    const std::unique_ptr<int[]> selected(new int[nPx]);
+    #pragma omp parallel for default(none) \
+            shared(nPx, nSelected, firstSelected, idx, less, selected) \
+            if(nPx >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPx; i++)
+        selected[i] = nSelected > 0 && !less(i, idx[firstSelected]);
+    stableScatter(selected.get(), nPx, 2, sortedIdx);
 
-    return result;
+    #pragma omp parallel for default(none) \
+            shared(nPx, firstSelected, idx, sortedIdx) \
+            if(nPx >= MIN_PARALLEL_PIXELS)
+    for (int r = firstSelected; r < nPx; r++)
+        sortedIdx[idx[r]] = r;
 }
 
 struct PseudoBubble2 : public Sorter::SorterImpl {
@@ -378,25 +1418,33 @@ struct PseudoBubble2 : public Sorter::SorterImpl {
 
     ~PseudoBubble2() override = default;
 
-    SegmentPixels operator()(
-            const SegmentPixels &base,
-            const SegmentPixels &skewed) const override;
+    void operator()(const SegmentPixels &base,
+                    const SegmentPixels &skewed,
+                    const float *keys,
+                    SegmentPixels &out) const override;
+
+    void permutation(const SegmentPixels &base,
+                     const SegmentPixels &skewed,
+                     const float *keys,
+                     int *perm) const override;
 
 private:
+    /**
+     * Returns the (ascending) indices of the pixels to sort: the pixels
+     * whose keys are among the largest, and the pixels in the endcap.
+     */
+    [[nodiscard]]
+    std::vector<int> filter(const float *proj, int nPx) const;
+
     Map projectPixel;
-    Map mixPixels;
+    Mixer mixPixels;
     double fraction;
 
     int maxBuckets;
     float fineStep;
 };
 
-SegmentPixels PseudoBubble2::operator()(
-        const SegmentPixels &base,
-        const SegmentPixels &skewed) const {
-    int const nPx = base.size();
-    int const nCh = base.depth();
-
+std::vector<int> PseudoBubble2::filter(const float *proj, int nPx) const {
     std::unique_ptr<int[]> const initBkt(new int[nPx]);
     int initCounts[maxBuckets];
 #pragma omp simd
@@ -405,12 +1453,9 @@ SegmentPixels PseudoBubble2::operator()(
 
 #pragma omp parallel for default(none) \
             reduction(+:initCounts[:maxBuckets]) \
-            shared(nPx, skewed, initBkt)
+            shared(nPx, proj, initBkt) if(nPx >= MIN_PARALLEL_PIXELS)
     for (int i = 0; i < nPx; i++) {
-        float pxProj;
-        projectPixel(skewed.px(i), &pxProj);
-
-        initBkt[i] = clamp(static_cast<int>(std::floor(pxProj / fineStep)),
+        initBkt[i] = clamp(static_cast<int>(std::floor(proj[i] / fineStep)),
                            0, maxBuckets - 1);
         initCounts[initBkt[i]]++;
     }
@@ -426,23 +1471,86 @@ SegmentPixels PseudoBubble2::operator()(
         size += initCounts[minBkt];
     }
 
-    int endcap = nPx - target;
-    std::vector<int> filterIdx;
-    for (int i = 0; i < endcap; i++) {
-        if (initBkt[i] >= minBkt)
-            filterIdx.push_back(i);
+    // The pixels to sort are gathered in order by a stable scatter of the
+    // pixels into those to sort (bucket 0) and those to skip (bucket 1).
+    const int endcap = nPx - target;
+    const std::unique_ptr<int[]> skip(new int[nPx]);
+    int nFiltered = 0;
+    #pragma omp parallel for default(none) \
+            shared(nPx, endcap, initBkt, minBkt, skip) \
+            reduction(+:nFiltered) if(nPx >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPx; i++) {
+        skip[i] = i < endcap && initBkt[i] < minBkt;
+        nFiltered += !skip[i];
     }
-    for (int i = endcap; i < nPx; i++)
-        filterIdx.push_back(i);
 
-    auto rBase = base.restrictToIndices(filterIdx);
-    SegmentPixels rSkew = skewed;
-    rSkew._setView(rBase._getView());
+    const std::unique_ptr<int[]> pos(new int[nPx]);
+    stableScatter(skip.get(), nPx, 2, pos.get());
 
-    auto result = bucketSort(rBase, rSkew, projectPixel, mixPixels, maxBuckets);
-    result._setView(base._getView());
+    std::vector<int> filterIdx(nFiltered);
+    #pragma omp parallel for default(none) shared(nPx, skip, pos, filterIdx) \
+            if(nPx >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nPx; i++)
+        if (!skip[i])
+            filterIdx[pos[i]] = i;
 
-    return result;
+    return filterIdx;
+}
+
+void PseudoBubble2::operator()(const SegmentPixels &base,
+                               const SegmentPixels &skewed,
+                               const float *keys,
+                               SegmentPixels &out) const {
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+    const auto filterIdx = filter(proj.get(), base.size());
+    const int nFiltered = static_cast<int>(filterIdx.size());
+
+    // reuse the keys of the filtered pixels rather than re-projecting them
+    std::vector<float> filterKeys(nFiltered);
+    #pragma omp parallel for default(none) \
+            shared(nFiltered, filterKeys, proj, filterIdx) \
+            if(nFiltered >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nFiltered; i++)
+        filterKeys[i] = proj[filterIdx[i]];
+
+    std::vector<int> sortedIdx(nFiltered);
+    bucketIndices(filterKeys.data(), nFiltered, maxBuckets, sortedIdx.data());
+
+    // pixels that are filtered out keep their base values
+    const SegmentPixels src = unaliased(skewed, out);
+    copyPixels(base, out);
+
+    SegmentPixels rOut = out.restrictToIndices(filterIdx);
+    mixAll(rOut, src.restrictToIndices(filterIdx), sortedIdx.data(),
+           mixPixels);
+}
+
+void PseudoBubble2::permutation(const SegmentPixels &base,
+                                const SegmentPixels &skewed,
+                                const float *keys,
+                                int *perm) const {
+    const int nPx = base.size();
+    const auto proj = sortKeys(skewed, projectPixel, keys);
+    const auto filterIdx = filter(proj.get(), nPx);
+    const int nFiltered = static_cast<int>(filterIdx.size());
+
+    std::vector<float> filterKeys(nFiltered);
+    #pragma omp parallel for default(none) \
+            shared(nFiltered, filterKeys, proj, filterIdx) \
+            if(nFiltered >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nFiltered; i++)
+        filterKeys[i] = proj[filterIdx[i]];
+
+    std::vector<int> sortedIdx(nFiltered);
+    bucketIndices(filterKeys.data(), nFiltered, maxBuckets, sortedIdx.data());
+
+    // pixels that are filtered out stay in place
+    std::iota(perm, perm + nPx, 0);
+    #pragma omp parallel for default(none) \
+            shared(nFiltered, perm, filterIdx, sortedIdx) \
+            if(nFiltered >= MIN_PARALLEL_PIXELS)
+    for (int i = 0; i < nFiltered; i++)
+        perm[filterIdx[sortedIdx[i]]] = filterIdx[i];
 }
 
 
@@ -457,7 +1565,51 @@ Sorter pxsort::Sorter::bucketSort(
     auto depth = pixelProjection.inDim;
     return {
         depth,
-        std::make_shared<BucketSort>(pixelProjection, pixelMixer, nBuckets)};
+        std::make_shared<BucketSort>(pixelProjection.compile(),
+                                     pixelMixer.compile(), nBuckets)};
+}
+
+Sorter pxsort::Sorter::quantileBucketSort(
+        const Map &pixelProjection,
+        const Map &pixelMixer,
+        uint32_t nBuckets) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+    assert(nBuckets > 0);
+
+    auto depth = pixelProjection.inDim;
+    return {
+        depth,
+        std::make_shared<BucketSort>(pixelProjection.compile(),
+                                     pixelMixer.compile(), nBuckets, true)};
+}
+
+Sorter pxsort::Sorter::radixSort(const Map &pixelProjection,
+                                 const Map &pixelMixer) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<RadixSort>(pixelProjection.compile(),
+                                        pixelMixer.compile())};
+}
+
+Sorter pxsort::Sorter::windowed(const Map &pixelProjection,
+                                const Map &pixelMixer,
+                                int radius) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<Windowed>(pixelProjection.compile(),
+                                       pixelMixer.compile(), radius)};
 }
 
 Sorter pxsort::Sorter::heapify(const Map &pixelProjection,
@@ -469,7 +1621,8 @@ Sorter pxsort::Sorter::heapify(const Map &pixelProjection,
     auto depth = pixelProjection.inDim;
     return {
             depth,
-            std::make_shared<Heapify>(pixelProjection, pixelMixer)};
+            std::make_shared<Heapify>(pixelProjection.compile(),
+                                      pixelMixer.compile())};
 }
 
 Sorter pxsort::Sorter::bubble(const Map &pixelProjection,
@@ -482,7 +1635,22 @@ Sorter pxsort::Sorter::bubble(const Map &pixelProjection,
     auto depth = pixelProjection.inDim;
     return {
             depth,
-            std::make_shared<Bubble>(pixelProjection, pixelMixer, fraction)};
+            std::make_shared<Bubble>(pixelProjection.compile(),
+                                     pixelMixer.compile(), fraction)};
+}
+
+Sorter pxsort::Sorter::oddEvenBubble(const Map &pixelProjection,
+                                     const Map &pixelMixer,
+                                     double fraction) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<OddEvenBubble>(pixelProjection.compile(),
+                                            pixelMixer.compile(), fraction)};
 }
 
 pxsort::Sorter::Sorter(int32_t pixelDepth, std::shared_ptr<SorterImpl> pImpl)
@@ -493,7 +1661,108 @@ SegmentPixels pxsort::Sorter::operator()(
         const SegmentPixels &skewedPixels) const {
     assert(basePixels.depth() == this->pixelDepth);
     assert(skewedPixels.depth() == this->pixelDepth);
-    return (*pImpl)(basePixels, skewedPixels);
+    // the result is sorted in place in a copy of base
+    SegmentPixels result = basePixels.deepCopy();
+    (*pImpl)(result, skewedPixels, nullptr, result);
+    return result;
+}
+
+/**
+ * Returns the values of a SegmentPixels of depth 1.
+ */
+std::vector<float> keyValues(const SegmentPixels &keys) {
+    assert(keys.depth() == 1);
+    std::vector<float> values(keys.size());
+    for (int i = 0; i < keys.size(); i++)
+        values[i] = *keys.px(i);
+    return values;
+}
+
+SegmentPixels pxsort::Sorter::operator()(
+        const SegmentPixels &basePixels,
+        const SegmentPixels &skewedPixels,
+        const SegmentPixels &keys) const {
+    assert(basePixels.depth() == this->pixelDepth);
+    assert(skewedPixels.depth() == this->pixelDepth);
+    assert(keys.size() == basePixels.size());
+    SegmentPixels result = basePixels.deepCopy();
+    (*pImpl)(result, skewedPixels, keyValues(keys).data(), result);
+    return result;
+}
+
+void pxsort::Sorter::sortInto(const SegmentPixels &basePixels,
+                              const SegmentPixels &skewedPixels,
+                              SegmentPixels &out) const {
+    assert(basePixels.depth() == this->pixelDepth);
+    assert(skewedPixels.depth() == this->pixelDepth);
+    assert(out.depth() == this->pixelDepth);
+    assert(out.size() == basePixels.size());
+    (*pImpl)(basePixels, skewedPixels, nullptr, out);
+}
+
+void pxsort::Sorter::sortInto(const SegmentPixels &basePixels,
+                              const SegmentPixels &skewedPixels,
+                              const SegmentPixels &keys,
+                              SegmentPixels &out) const {
+    assert(basePixels.depth() == this->pixelDepth);
+    assert(skewedPixels.depth() == this->pixelDepth);
+    assert(keys.size() == basePixels.size());
+    assert(out.depth() == this->pixelDepth);
+    assert(out.size() == basePixels.size());
+    (*pImpl)(basePixels, skewedPixels, keyValues(keys).data(), out);
+}
+
+std::vector<int> pxsort::Sorter::permutation(
+        const SegmentPixels &basePixels,
+        const SegmentPixels &skewedPixels) const {
+    assert(basePixels.depth() == this->pixelDepth);
+    assert(skewedPixels.depth() == this->pixelDepth);
+    std::vector<int> perm(basePixels.size());
+    pImpl->permutation(basePixels, skewedPixels, nullptr, perm.data());
+    return perm;
+}
+
+std::vector<int> pxsort::Sorter::permutation(
+        const SegmentPixels &basePixels,
+        const SegmentPixels &skewedPixels,
+        const SegmentPixels &keys) const {
+    assert(basePixels.depth() == this->pixelDepth);
+    assert(skewedPixels.depth() == this->pixelDepth);
+    assert(keys.size() == basePixels.size());
+    std::vector<int> perm(basePixels.size());
+    pImpl->permutation(basePixels, skewedPixels, keyValues(keys).data(),
+                       perm.data());
+    return perm;
+}
+
+SegmentPixels pxsort::Sorter::applyPermutation(const SegmentPixels &pixels,
+                                               const std::vector<int> &perm) {
+    const int nPixels = pixels.size();
+    const int nChannels = pixels.depth();
+
+    if (perm.size() != static_cast<size_t>(nPixels))
+        throw std::invalid_argument(
+                "pxsort::Sorter: permutation size must match pixels.size()");
+    std::vector<bool> seen(nPixels, false);
+    for (int idx : perm) {
+        if (idx < 0 || idx >= nPixels)
+            throw std::invalid_argument(
+                    "pxsort::Sorter: permutation entries must be in "
+                    "[0, pixels.size())");
+        if (seen[idx])
+            throw std::invalid_argument(
+                    "pxsort::Sorter: permutation entries must be distinct");
+        seen[idx] = true;
+    }
+
+    SegmentPixels result = pixels.deepCopy();
+    #pragma omp parallel for default(none) \
+            shared(nPixels, nChannels, pixels, perm, result) \
+            if(nPixels >= MIN_PARALLEL_PIXELS)
+    for (int j = 0; j < nPixels; j++)
+        std::copy_n(pixels.px(perm[j]), nChannels, result.px(j));
+
+    return result;
 }
 
 Sorter
@@ -502,6 +1771,46 @@ pxsort::Sorter::pseudoBubble(const Map &pixelProjection, const Map &pixelMixer,
     auto depth = pixelProjection.inDim;
     return {
             depth,
-            std::make_shared<PseudoBubble>(pixelProjection, pixelMixer,
+            std::make_shared<PseudoBubble>(pixelProjection.compile(),
+                                           pixelMixer.compile(),
                                            fraction, maxBuckets)};
 }
+
+Sorter
+pxsort::Sorter::pseudoBubble2(const Map &pixelProjection, const Map &pixelMixer,
+                              double fraction, int maxBuckets) {
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<PseudoBubble2>(pixelProjection.compile(),
+                                            pixelMixer.compile(),
+                                            fraction, maxBuckets)};
+}
+
+Sorter pxsort::Sorter::partialSort(const Map &pixelProjection,
+                                   const Map &pixelMixer,
+                                   double fraction) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<PartialSort>(pixelProjection.compile(),
+                                          pixelMixer.compile(), fraction)};
+}
+
+Sorter pxsort::Sorter::mergeSort(const Map &pixelProjection,
+                                 const Map &pixelMixer,
+                                 int levels) {
+    assert(2 * pixelProjection.inDim == pixelMixer.inDim);
+    assert(pixelProjection.outDim == 1);
+    assert(pixelMixer.inDim == pixelMixer.outDim);
+
+    auto depth = pixelProjection.inDim;
+    return {
+            depth,
+            std::make_shared<MergeSort>(pixelProjection.compile(),
+                                        pixelMixer.compile(), levels)};
+}
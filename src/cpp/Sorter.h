@@ -1,11 +1,15 @@
 #ifndef PXSORT2_SORTER_H
 #define PXSORT2_SORTER_H
 
+#include <vector>
 #include "fwd.h"
 #include "Segment.h"
 
 /**
  * A callable object that sorts arrays of pixels.
+ *
+ * The Maps given to a Sorter's factory functions are compiled (see
+ * Map::compile) when the Sorter is created.
  */
 class pxsort::Sorter {
 public:
@@ -26,11 +30,107 @@ public:
             const SegmentPixels &basePixels,
             const SegmentPixels &skewedPixels) const;
 
+    /**
+     * Like operator()(basePixels, skewedPixels), but orders pixels by the
+     * given precomputed keys instead of evaluating this Sorter's projection.
+     * Keys are typically read from a key image produced by Image::project,
+     * using the same Segment (and Skew) as the pixels they describe, so that
+     * the projection is evaluated once per image rather than once per
+     * Segment.
+     * The ith key describes the ith of the pixels that this Sorter projects:
+     * the skewed pixels for bucketSort, quantileBucketSort, radixSort,
+     * windowed, partialSort, mergeSort, pseudoBubble and pseudoBubble2, and
+     * the base pixels for bubble and oddEvenBubble. heapify uses keys as the
+     * initial projections of the skewed pixels, and re-projects pixels as it
+     * mixes them.
+     * @param basePixels The SegmentPixels to sort.
+     * @param skewedPixels The skewed SegmentPixels to sort into base.
+     * @param keys A SegmentPixels of depth 1, with the same size() as base.
+     * @return
+     */
+    [[nodiscard]]
+    SegmentPixels operator()(
+            const SegmentPixels &basePixels,
+            const SegmentPixels &skewedPixels,
+            const SegmentPixels &keys) const;
+
+    /**
+     * Like operator()(basePixels, skewedPixels), but writes the result to
+     * the pixels of out instead of a newly allocated copy of basePixels, so
+     * that one buffer can be reused for every Segment of every frame.
+     * out may be basePixels itself (or any SegmentPixels with the same
+     * backing array and view), in which case the pixels are sorted in
+     * place. Pixels of out's backing array outside of its view are not
+     * written.
+     * Inputs are never copied unless they share out's backing array. If
+     * skewedPixels does (e.g. sortInto(px, px, px)), and the Sorter reads
+     * skewed pixels after it has started writing out, then the pixels in
+     * skewedPixels' view (and only those) are first copied to a scratch
+     * buffer.
+     * @param basePixels The SegmentPixels to sort.
+     * @param skewedPixels The skewed SegmentPixels to sort into base.
+     * @param out A SegmentPixels with the same size() and depth() as base.
+     */
+    void sortInto(const SegmentPixels &basePixels,
+                  const SegmentPixels &skewedPixels,
+                  SegmentPixels &out) const;
+
+    /**
+     * Like sortInto(basePixels, skewedPixels, out), but orders pixels by the
+     * given precomputed keys (see operator()).
+     */
+    void sortInto(const SegmentPixels &basePixels,
+                  const SegmentPixels &skewedPixels,
+                  const SegmentPixels &keys,
+                  SegmentPixels &out) const;
+
+    /**
+     * Computes the order in which this Sorter arranges pixels, without
+     * mixing them.
+     * The result is the arrangement of the skewed pixels that
+     * operator()(basePixels, skewedPixels) produces when its mixer swaps
+     * whole pixels, so that one ordering can be computed (e.g. on a cheap
+     * proxy of an image) and then applied to several SegmentPixels with
+     * applyPermutation.
+     * @param basePixels The SegmentPixels to sort.
+     * @param skewedPixels The skewed SegmentPixels to sort into base.
+     * @return A permutation perm of [0, base.size()): the skewed pixel at
+     *   index perm[j] is placed at index j.
+     */
+    [[nodiscard]]
+    std::vector<int> permutation(const SegmentPixels &basePixels,
+                                 const SegmentPixels &skewedPixels) const;
+
+    /**
+     * Like permutation(basePixels, skewedPixels), but orders pixels by the
+     * given precomputed keys (see operator()).
+     */
+    [[nodiscard]]
+    std::vector<int> permutation(const SegmentPixels &basePixels,
+                                 const SegmentPixels &skewedPixels,
+                                 const SegmentPixels &keys) const;
+
+    /**
+     * Returns a (deep) copy of pixels, rearranged by a permutation returned
+     * by Sorter::permutation: pixel j of the result is pixels.px(perm[j]).
+     * pixels may have any depth.
+     * @param pixels
+     * @param perm A permutation of [0, pixels.size()).
+     * @throws std::invalid_argument If perm's size differs from
+     *   pixels.size(), an entry of perm is outside [0, pixels.size()), or
+     *   an entry of perm is repeated.
+     * @return
+     */
+    [[nodiscard]]
+    static SegmentPixels applyPermutation(const SegmentPixels &pixels,
+                                          const std::vector<int> &perm);
+
     /**
      * Returns a Sorter that efficiently sorts all pixels in a SegmentPixels.
      *
      * This Sorter uses a bucket-sort implementation, which has a runtime of
-     * O(n).
+     * O(n). The sort is stable (pixels in the same bucket keep their
+     * original order), so its output is deterministic.
      * @param pixelProjection A Map from [0, 1]^d to [0, 1] (where d is pixel
      *   depth). This Map is used to determine the order of pixels.
      * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
@@ -47,6 +147,72 @@ public:
                              const Map &pixelMixer,
                              uint32_t nBuckets);
 
+    /**
+     * Returns a Sorter that bucket-sorts the pixels in a SegmentPixels, like
+     * bucketSort, but with buckets that each hold about the same number of
+     * pixels rather than buckets of equal width.
+     *
+     * Bucket boundaries are the quantiles of a sample of the pixels'
+     * projections, so pixels are spread over all buckets even when their
+     * projections are concentrated in a narrow range (e.g. the lightness of
+     * dark footage), and the work of the parallel scatter stays balanced.
+     * Runtime is O(n log nBuckets). The sort is stable.
+     * @param pixelProjection A Map from R^d to R (where d is pixel depth).
+     *   This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared. Note that this version of the Sorter ignores the
+     *   last d elements of a pixelMixer's output.
+     * @param nBuckets The number of buckets.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter quantileBucketSort(const Map &pixelProjection,
+                                     const Map &pixelMixer,
+                                     uint32_t nBuckets);
+
+    /**
+     * Returns a Sorter that exactly sorts all pixels in a SegmentPixels.
+     *
+     * Pixels' projections are computed once, and are then sorted with an
+     * LSD radix sort on their bit patterns, which has a runtime of O(n).
+     * The sort is stable (pixels with equal projections keep their original
+     * order).
+     * @param pixelProjection A Map from R^d to R (where d is pixel depth).
+     *   This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared. Note that this version of the Sorter ignores the
+     *   last d elements of a pixelMixer's output.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter radixSort(const Map &pixelProjection,
+                            const Map &pixelMixer);
+
+    /**
+     * Returns a Sorter that partially sorts the pixels in a SegmentPixels,
+     * moving each pixel at most radius positions.
+     *
+     * Pixels are sorted within blocks of about radius / 2 pixels, and then
+     * within blocks offset by half a block, so that pixels drift towards
+     * their sorted positions across block boundaries. Blocks are sorted
+     * independently, in parallel, in O(n log radius) total time. The sort is
+     * stable.
+     * @param pixelProjection A Map from R^d to R (where d is pixel depth).
+     *   This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared. Note that this version of the Sorter ignores the
+     *   last d elements of a pixelMixer's output.
+     * @param radius The maximum distance that a pixel is moved.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter windowed(const Map &pixelProjection,
+                           const Map &pixelMixer,
+                           int radius);
+
     /**
      * Fast approximation of a partial bubble-sort effect.
      * @param pixelProjection
@@ -61,6 +227,50 @@ public:
                                double fraction,
                                int maxBuckets);
 
+    /**
+     * Fast approximation of a partial bubble-sort effect that leaves most
+     * pixels in place.
+     *
+     * Like pseudoBubble, pixels' projections are binned into maxBuckets
+     * equal-width buckets to find the (about) fraction * n largest pixels.
+     * Only those pixels and the last fraction * n pixels are bucket-sorted,
+     * among their own positions; all other pixels keep their base values.
+     * @param pixelProjection
+     * @param pixelMixer
+     * @param fraction
+     * @param maxBuckets
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter pseudoBubble2(const Map &pixelProjection,
+                                const Map &pixelMixer,
+                                double fraction,
+                                int maxBuckets);
+
+    /**
+     * Returns a Sorter that exactly sorts the largest pixels in a
+     * SegmentPixels, with the effect that pseudoBubble approximates.
+     *
+     * The ceil(fraction * n) pixels with the largest projections are found
+     * by selection (introselect), in O(n) time, and only they are sorted, in
+     * O(k log k) time, and moved to the end; the other pixels keep their
+     * original order. Pixels with equal projections keep their original
+     * order.
+     * @param pixelProjection A Map from R^d to R (where d is pixel depth).
+     *   This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared. Note that this version of the Sorter ignores the
+     *   last d elements of a pixelMixer's output.
+     * @param fraction A number in the interval [0, 1]: the fraction of the
+     *   pixels to sort.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter partialSort(const Map &pixelProjection,
+                              const Map &pixelMixer,
+                              double fraction);
+
     /**
      * Returns a sorter that builds a max-heap from the pixels in a
      * SegmentPixels.
@@ -86,6 +296,9 @@ public:
      *   last d elements of a pixelMixer's output.
      * @param fraction A number in the interval (0, 1]. Used to determine where
      * to stop in the bubble-sort process.
+     * If pixelMixer swaps channels of a pair of pixels (e.g. Map::swap), the
+     * result of the bubble-sort passes is computed directly, in
+     * O(n log n) time, rather than by performing them.
      * @return
      */
     [[nodiscard]]
@@ -93,6 +306,55 @@ public:
                          const Map &pixelMixer,
                          double fraction);
 
+    /**
+     * Returns a Sorter that performs a (partial) bottom-up merge sort on the
+     * given SegmentPixels, and mixes pixels as they are merged.
+     *
+     * Level l of the sort merges pairs of adjacent sorted runs of 2^l
+     * pixels. Whenever the head of the second run is moved ahead of the
+     * head of the first run, the pair is mixed: the first pixel of the
+     * mixer's output is moved ahead, and the second pixel replaces the head
+     * of the first run. With a swap mixer, this is an ordinary stable merge
+     * sort. Pixels' keys are computed once; keys follow pixels as if they
+     * were swapped. The merges of a level are independent, so each level is
+     * processed in parallel.
+     * @param pixelProjection A Map from R^d to R (where d is pixel depth).
+     *   This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared.
+     * @param levels The number of merge levels to perform; sorting n pixels
+     *   takes ceil(log2(n)) levels. A negative number of levels fully sorts
+     *   the pixels.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter mergeSort(const Map &pixelProjection,
+                            const Map &pixelMixer,
+                            int levels);
+
+    /**
+     * Returns a Sorter that performs a partial odd-even transposition sort
+     * (a parallel variant of bubble-sort) on the given SegmentPixels.
+     *
+     * Each phase compares every other adjacent pair of pixels, alternating
+     * between pairs starting at even and at odd indices, and mixes the pairs
+     * that are out of order. The pairs within a phase are independent, so
+     * each phase is processed in parallel. n phases fully sort n pixels.
+     * @param pixelProjection A Map from [0, 1]^d to [0, 1] (where d is pixel
+     *   depth). This Map is used to determine the order of pixels.
+     * @param pixelMixer A Map from [0, 1]^2d to [0, 1]^2d (where d is pixel
+     *   depth). This Map is used to combine or "swap" a pair of pixels that
+     *   are being compared.
+     * @param fraction A number in the interval (0, 1]. The number of phases
+     * performed is fraction * n.
+     * @return
+     */
+    [[nodiscard]]
+    static Sorter oddEvenBubble(const Map &pixelProjection,
+                                const Map &pixelMixer,
+                                double fraction);
+
 private:
     Sorter(int32_t pixelDepth, std::shared_ptr<SorterImpl> pImpl);
 
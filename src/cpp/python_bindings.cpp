@@ -135,16 +135,41 @@ void bindImage(py::module_ &m) {
             .def("__array__",
                  [](Image &img) {return py::array(imageBuffer(img));})
             .def("A",
-                 [](Image &img) {return py::array(imageBuffer(img));});
+                 [](Image &img) {return py::array(imageBuffer(img));})
+            .def("project", &Image::project,
+                 py::call_guard<py::gil_scoped_release>());
 }
 
 void bindMap(py::module_ &m) {
+    py::enum_<Map::Blend>(m, "BlendMode",
+                          "Ways of combining a pair of pixels' channel values.")
+            .value("Min", Map::MIN)
+            .value("Max", Map::MAX)
+            .value("Average", Map::AVERAGE)
+            .value("Multiply", Map::MULTIPLY)
+            .value("Screen", Map::SCREEN)
+            .value("Difference", Map::DIFFERENCE)
+            .value("Xor", Map::XOR);
+
     py::class_<Map>(m, "Map")
             .def(py::init([](uint64_t f_ptr, uint32_t in_dim, uint32_t out_dim)
             {
                 return Map(reinterpret_cast<Map::fp_t>(f_ptr),
                            in_dim, out_dim);
             }))
+            .def_static("batched",
+                        [](uint64_t f_ptr, uint32_t in_dim, uint32_t out_dim)
+            {
+                return Map(reinterpret_cast<Map::batch_fp_t>(f_ptr),
+                           in_dim, out_dim);
+            })
+            .def_static("parameterized",
+                        [](uint64_t f_ptr, uint32_t in_dim, uint32_t out_dim,
+                           std::vector<float> params)
+            {
+                return Map(reinterpret_cast<Map::param_fp_t>(f_ptr),
+                           in_dim, out_dim, std::move(params));
+            })
             .def_readonly("in_dim", &Map::inDim)
             .def_readonly("out_dim", &Map::outDim)
             .def("__lshift__", &Map::operator<<)
@@ -154,9 +179,50 @@ void bindMap(py::module_ &m) {
             .def("__call__", [](const Map &m, const std::vector<float> &x) {
                 return m(x);
             })
+            .def("batch", [](const Map &m, const py::array_t<float,
+                                 py::array::c_style | py::array::forcecast> &x)
+            {
+                if (x.ndim() != 2 || x.shape(1) != m.inDim)
+                    throw std::runtime_error("Incompatible array shape: "
+                                             "expected (n, in_dim).");
+                const auto n = static_cast<int32_t>(x.shape(0));
+                py::array_t<float> y({static_cast<py::ssize_t>(n),
+                                      static_cast<py::ssize_t>(m.outDim)});
+                m(x.data(), m.inDim, y.mutable_data(), m.outDim, n);
+                return y;
+            })
+            .def("compile", &Map::compile)
+            .def("tabulate", &Map::tabulate,
+                 py::arg("resolution"), py::arg("interpolate") = false,
+                 py::call_guard<py::gil_scoped_release>())
+            .def_property("params", &Map::params, &Map::setParams)
+            .def_property_readonly("selection", &Map::selection)
+            .def("instrumented", &Map::instrumented)
+            .def("profile", [](const Map &m) {
+                std::vector<py::tuple> entries;
+                for (const auto &e : m.profile())
+                    entries.push_back(py::make_tuple(
+                            e.name, e.depth, e.calls, e.inputs, e.seconds));
+                return entries;
+            })
+            .def("reset_profile", &Map::resetProfile)
             .def("__eq__", &Map::operator==)
             .def_static("concatenate", &Map::concatenate)
-            .def_static("constant", &Map::constant);
+            .def_static("constant", &Map::constant)
+            .def_static("identity", &Map::identity)
+            .def_static("select", &Map::select)
+            .def_static("channel", &Map::channel)
+            .def_static("weighted_sum", &Map::weightedSum)
+            .def_static("luminance", &Map::luminance)
+            .def_static("lightness", &Map::lightness)
+            .def_static("value", &Map::value)
+            .def_static("hue", &Map::hue)
+            .def_static("hsv_saturation", &Map::hsvSaturation)
+            .def_static("hsl_saturation", &Map::hslSaturation)
+            .def_static("to_hsv", &Map::toHSV)
+            .def_static("to_hsl", &Map::toHSL)
+            .def_static("swap", &Map::swap)
+            .def_static("blend", &Map::blend);
 }
 
 void bindSegment(py::module_ &m) {
@@ -284,11 +350,60 @@ void bindSegmentPixels(py::module_ &m) {
 void bindSorter(py::module_ &m) {
     py::class_<Sorter>(m, "Sorter")
             .def_static("create_bucket_sorter", &Sorter::bucketSort)
+            .def_static("create_quantile_bucket_sorter",
+                        &Sorter::quantileBucketSort)
+            .def_static("create_radix_sorter", &Sorter::radixSort)
+            .def_static("create_windowed_sorter", &Sorter::windowed)
+            .def_static("create_partial_sorter", &Sorter::partialSort)
+            .def_static("create_merge_sorter", &Sorter::mergeSort)
             .def_static("create_heapify_sorter", &Sorter::heapify)
             .def_static("create_bubble_sorter", &Sorter::bubble)
+            .def_static("create_odd_even_bubble_sorter",
+                        &Sorter::oddEvenBubble)
             .def_static("create_pseudo_bubble_sorter", &Sorter::pseudoBubble)
-            .def("__call__", &Sorter::operator(),
-                 py::call_guard<py::gil_scoped_release>());
+            .def_static("create_pseudo_bubble2_sorter", &Sorter::pseudoBubble2)
+            .def("__call__",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &>(
+                         &Sorter::operator(), py::const_),
+                 py::call_guard<py::gil_scoped_release>())
+            .def("__call__",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &,
+                                   const SegmentPixels &>(
+                         &Sorter::operator(), py::const_),
+                 py::arg("base"), py::arg("skewed"), py::arg("keys"),
+                 py::call_guard<py::gil_scoped_release>())
+            .def("sort_into",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &,
+                                   SegmentPixels &>(
+                         &Sorter::sortInto, py::const_),
+                 py::arg("base"), py::arg("skewed"), py::arg("out"),
+                 py::call_guard<py::gil_scoped_release>())
+            .def("sort_into",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &,
+                                   const SegmentPixels &,
+                                   SegmentPixels &>(
+                         &Sorter::sortInto, py::const_),
+                 py::arg("base"), py::arg("skewed"), py::arg("keys"),
+                 py::arg("out"),
+                 py::call_guard<py::gil_scoped_release>())
+            .def("permutation",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &>(
+                         &Sorter::permutation, py::const_),
+                 py::call_guard<py::gil_scoped_release>())
+            .def("permutation",
+                 py::overload_cast<const SegmentPixels &,
+                                   const SegmentPixels &,
+                                   const SegmentPixels &>(
+                         &Sorter::permutation, py::const_),
+                 py::arg("base"), py::arg("skewed"), py::arg("keys"),
+                 py::call_guard<py::gil_scoped_release>())
+            .def_static("apply_permutation", &Sorter::applyPermutation,
+                        py::call_guard<py::gil_scoped_release>());
 }
 
 void bindEllipse(py::module_ &m) {
@@ -1,4 +1,4 @@
-from ._native import Map
+from ._native import Map, BlendMode
 
 from numba import types
 
@@ -6,3 +6,34 @@ from numba import types
 def map_function_signature():
     return types.void(types.CPointer(types.float32), types.uint32,
                       types.CPointer(types.float32), types.uint32)
+
+
+def map_parameterized_function_signature():
+    return types.void(types.CPointer(types.float32), types.uint32,
+                      types.CPointer(types.float32), types.uint32,
+                      types.CPointer(types.float32), types.uint32)
+
+
+def map_batch_function_signature():
+    return types.void(types.CPointer(types.float32), types.int32, types.int32,
+                      types.CPointer(types.float32), types.int32, types.int32,
+                      types.int32)
+
+
+def profile_report(m: Map) -> str:
+    """
+    Formats the counters recorded by an instrumented Map (see
+    Map.instrumented) as a table, with one row per node of the Map's
+    expression tree. Children are indented beneath their parents.
+    """
+    rows = [("node", "calls", "inputs", "seconds", "us/input")]
+    for name, depth, calls, inputs, seconds in m.profile():
+        per_input = 1e6 * seconds / inputs if inputs else 0.0
+        rows.append(("  " * depth + name, str(calls), str(inputs),
+                     f"{seconds:.6f}", f"{per_input:.3f}"))
+
+    widths = [max(len(row[j]) for row in rows) for j in range(len(rows[0]))]
+    return "\n".join(
+        row[0].ljust(widths[0]) + "".join(
+            "  " + cell.rjust(w) for cell, w in zip(row[1:], widths[1:]))
+        for row in rows)
@@ -1,4 +1,9 @@
+import colorsys
+import ctypes
+
 from numba import cfunc, carray
+import numpy as np
+import pytest
 import pxsort
 
 
@@ -16,3 +21,219 @@ def test_jit_callback():
     lst_in = [float(i) for i in range(10)]
     lst_out = m(lst_in)
     assert lst_out == lst_in[::-1]
+
+
+@cfunc(pxsort.map_batch_function_signature())
+def array_reverse_batch(a_in, m, in_stride, a_out, n, out_stride, count):
+    in_array = carray(a_in, (count * in_stride,))
+    out_array = carray(a_out, (count * out_stride,))
+    dim = min(m, n)
+    for k in range(count):
+        for i in range(dim):
+            out_array[k * out_stride + i] = \
+                in_array[k * in_stride + (dim - 1) - i]
+
+
+def test_batched_jit_callback():
+    m = pxsort.Map.batched(array_reverse_batch.address, 4, 4)
+    lst_in = [float(i) for i in range(4)]
+    assert m(lst_in) == lst_in[::-1]
+
+    x = np.arange(20, dtype='float32').reshape(5, 4)
+    assert np.array_equal(m.batch(x), x[:, ::-1])
+
+
+@cfunc(pxsort.map_parameterized_function_signature())
+def scale_and_shift(a_in, m, a_out, n, a_params, n_params):
+    in_array = carray(a_in, (m,))
+    out_array = carray(a_out, (n,))
+    params = carray(a_params, (n_params,))
+    for i in range(n):
+        out_array[i] = params[0] * in_array[i] + params[1]
+
+
+def test_parameterized_jit_callback():
+    m = pxsort.Map.parameterized(scale_and_shift.address, 2, 2, [2.0, 1.0])
+    composed = pxsort.Map.channel(1, 2) << m
+    compiled = composed.compile()
+    assert m.params == [2.0, 1.0]
+    assert m([1.0, 2.0]) == [3.0, 5.0]
+
+    m.params = [0.5, 0.0]
+    assert m([1.0, 2.0]) == [0.5, 1.0]
+    assert composed([1.0, 2.0]) == [1.0]
+    assert compiled([1.0, 2.0]) == [1.0]
+
+    with pytest.raises(ValueError):
+        m.params = [1.0]
+    with pytest.raises(ValueError):
+        composed.params = [1.0, 2.0]
+
+
+def test_batch_matches_single_evaluation():
+    rev = pxsort.Map(array_reverse.address, 4, 4)
+    m = (rev[1] ** rev[3]) | pxsort.Map.constant([0.5], 2)
+    x = np.arange(30, dtype='float32').reshape(5, 6)
+    expected = np.array([m(list(map(float, row))) for row in x])
+    assert np.allclose(m.batch(x), expected)
+
+
+def test_compiled_map_matches_tree():
+    rev = pxsort.Map(array_reverse.address, 3, 3)
+    mix = pxsort.Map.concatenate([rev, pxsort.Map.constant([0.25, 0.75], 3)])
+    m = ((rev[0] ** rev[2]) | mix[1]) << (rev ** rev ** rev)
+    compiled = m.compile()
+    assert compiled.in_dim == m.in_dim and compiled.out_dim == m.out_dim
+
+    x = np.arange(12, dtype='float32').reshape(4, 3)
+    for row in x:
+        assert compiled(list(map(float, row))) == m(list(map(float, row)))
+    assert np.array_equal(compiled.batch(x), m.batch(x))
+
+
+def counting_map(in_dim, out_dim):
+    """
+    Returns a Map backed by a Python callback along with the list that the
+    callback appends to each time it is invoked.
+    """
+    calls = []
+
+    @ctypes.CFUNCTYPE(None, ctypes.POINTER(ctypes.c_float), ctypes.c_uint32,
+                      ctypes.POINTER(ctypes.c_float), ctypes.c_uint32)
+    def _callback(a_in, m, a_out, n):
+        calls.append(m)
+        for i in range(n):
+            a_out[i] = 0.0
+
+    address = ctypes.cast(_callback, ctypes.c_void_p).value
+    counting_map.callbacks.append(_callback)
+    return pxsort.Map(address, in_dim, out_dim), calls
+
+
+counting_map.callbacks = []
+
+
+def test_projection_skips_unused_branches():
+    rev = pxsort.Map(array_reverse.address, 3, 3)
+    counted, calls = counting_map(3, 3)
+    m = (counted ** rev) | (rev ** counted)
+    x = [1.0, 2.0, 3.0, 4.0, 5.0, 6.0]
+
+    expected = m(x)[4]
+    for proj in [m[4], m[4].compile(), m.compile()[4]]:
+        calls.clear()
+        assert proj(x) == [expected]
+        assert len(calls) == 0
+
+
+def test_builtin_colour_maps():
+    rgb = [0.8, 0.4, 0.2]
+    h, s, v = colorsys.rgb_to_hsv(*rgb)
+    hh, ll, ss = colorsys.rgb_to_hls(*rgb)
+
+    assert np.allclose(pxsort.Map.to_hsv()(rgb), [h, s, v])
+    assert np.allclose(pxsort.Map.to_hsl()(rgb), [hh, ss, ll])
+    assert np.allclose(pxsort.Map.hue()(rgb), [h])
+    assert np.allclose(pxsort.Map.lightness()(rgb), [ll])
+    assert np.allclose(pxsort.Map.luminance()(rgb),
+                       [0.2126 * 0.8 + 0.7152 * 0.4 + 0.0722 * 0.2])
+
+    bgr_hue = pxsort.Map.hue() << pxsort.Map.select([2, 1, 0], 3)
+    assert np.allclose(bgr_hue(rgb[::-1]), [h])
+
+    x = np.random.default_rng(0).random((100, 3), dtype='float32')
+    expected = [colorsys.rgb_to_hsv(*px) for px in x]
+    assert np.allclose(pxsort.Map.to_hsv().batch(x), expected, atol=1e-6)
+
+
+def test_builtin_mixers():
+    pair = [0.1, 0.2, 0.3, 0.6, 0.5, 0.4]
+    assert pxsort.Map.swap([0, 2], 3)(pair) == pytest.approx(
+        [0.6, 0.2, 0.4, 0.1, 0.5, 0.3])
+    assert pxsort.Map.blend(pxsort.BlendMode.Max, 3)(pair) == pytest.approx(
+        [0.6, 0.5, 0.4, 0.6, 0.5, 0.4])
+    assert pxsort.Map.blend(pxsort.BlendMode.Xor, 1)([1.0, 1.0]) == \
+        pytest.approx([0.0, 1.0])
+
+
+def test_builtin_batch_matches_single_evaluation():
+    rng = np.random.default_rng(1)
+    x = rng.random((1001, 3), dtype='float32')
+    x[:10] = [[0, 0, 0], [1, 1, 1], [0.5, 0.5, 0.5], [1, 0, 0], [0, 1, 0],
+              [0, 0, 1], [1, 1, 0], [0, 1, 1], [1, 0, 1], [0.2, 0.2, 0.7]]
+    # hues just below 0, which wrap to 0 rather than to 1
+    x[10:20] = [1, 0, 1e-8]
+
+    maps = [pxsort.Map.lightness(), pxsort.Map.value(), pxsort.Map.hue(),
+            pxsort.Map.hsv_saturation(), pxsort.Map.hsl_saturation(),
+            pxsort.Map.luminance(), pxsort.Map.weighted_sum([0.5, -1, 2])]
+    for m in maps:
+        expected = np.array([m(list(map(float, px))) for px in x],
+                            dtype='float32')
+        assert np.array_equal(m.batch(x), expected)
+
+    hues = pxsort.Map.hue().batch(x)
+    assert np.all((0 <= hues) & (hues < 1))
+
+
+def test_tabulated_maps():
+    rng = np.random.default_rng(2)
+
+    hue = pxsort.Map.hue()
+    table = hue.tabulate(256)
+    x = rng.integers(0, 256, (500, 3)).astype('float32') / 255
+    assert np.allclose(table.batch(x), hue.batch(x), atol=1e-5)
+
+    linear = pxsort.Map.weighted_sum([0.25, 0.5, -0.75])
+    table = linear.tabulate(5, interpolate=True)
+    x = rng.random((500, 3), dtype='float32')
+    assert np.allclose(table.batch(x), linear.batch(x), atol=1e-5)
+
+    with pytest.raises(ValueError):
+        pxsort.Map.to_hsv().tabulate(16)
+    with pytest.raises(ValueError):
+        pxsort.Map.constant([0.5], 0).tabulate(4)
+
+    # tables of a single high-resolution row
+    table = pxsort.Map.channel(0, 1).tabulate(1 << 24)
+    x = np.array([[0], [0.25], [1]], dtype='float32')
+    assert np.allclose(table.batch(x), x, atol=1e-6)
+
+
+def test_instrumented_map_profile():
+    f, _ = counting_map(3, 1)
+    m = (f ** pxsort.Map.hue()) << pxsort.Map.select([2, 1, 0], 3)
+    assert m.profile() == []
+
+    profiled = m.instrumented()
+    x = np.random.default_rng(3).random((10, 3), dtype=np.float32)
+    assert np.array_equal(profiled.batch(x), m.batch(x))
+    profiled([0.1, 0.2, 0.3])
+
+    entries = profiled.profile()
+    names = [(name, depth) for name, depth, *_ in entries]
+    assert names == [("composition", 0), ("fork", 1), (names[2][0], 2),
+                     ("hue", 2), ("select(2, 1, 0)", 1)]
+    for _, _, calls, inputs, seconds in entries:
+        assert calls >= 2 and inputs == 11 and seconds >= 0
+
+    report = pxsort.profile_report(profiled)
+    assert len(report.splitlines()) == len(entries) + 1
+
+    profiled.reset_profile()
+    assert all(calls == 0 for _, _, calls, _, _ in profiled.profile())
+
+
+def test_compiled_map_evaluates_shared_sub_maps_once():
+    counted, calls = counting_map(3, 3)
+    m = counted[0] ** counted[2] ** (counted << pxsort.Map.identity(3))[1]
+    x = [0.1, 0.2, 0.3]
+
+    calls.clear()
+    expected = m(x)
+    assert len(calls) == 3
+
+    compiled = m.compile()
+    calls.clear()
+    assert compiled(x) == expected
+    assert len(calls) == 1
@@ -0,0 +1,378 @@
+from numba import cfunc, carray
+import numpy as np
+import pxsort
+import pytest
+
+
+@cfunc(pxsort.map_function_signature())
+def first_channel(a_in, m, a_out, n):
+    in_array = carray(a_in, (m,))
+    out_array = carray(a_out, (n,))
+    out_array[0] = in_array[0]
+
+
+@cfunc(pxsort.map_function_signature())
+def swap_pixels(a_in, m, a_out, n):
+    in_array = carray(a_in, (m,))
+    out_array = carray(a_out, (n,))
+    depth = m // 2
+    for i in range(depth):
+        out_array[i] = in_array[depth + i]
+        out_array[depth + i] = in_array[i]
+
+
+DEPTH = 3
+project = pxsort.Map(first_channel.address, DEPTH, 1)
+swap = pxsort.Map(swap_pixels.address, 2 * DEPTH, 2 * DEPTH)
+
+
+# Creates each kind of Sorter with a given mixer, with parameters that keep
+# the partial sorters' effects partial.
+SORTER_FACTORIES = [
+    lambda mix: pxsort.Sorter.create_bucket_sorter(project, mix, 100),
+    lambda mix: pxsort.Sorter.create_quantile_bucket_sorter(project, mix, 100),
+    lambda mix: pxsort.Sorter.create_radix_sorter(project, mix),
+    lambda mix: pxsort.Sorter.create_windowed_sorter(project, mix, 16),
+    lambda mix: pxsort.Sorter.create_partial_sorter(project, mix, 0.1),
+    lambda mix: pxsort.Sorter.create_merge_sorter(project, mix, 5),
+    lambda mix: pxsort.Sorter.create_heapify_sorter(project, mix),
+    lambda mix: pxsort.Sorter.create_bubble_sorter(project, mix, 0.05),
+    lambda mix: pxsort.Sorter.create_odd_even_bubble_sorter(project, mix,
+                                                            0.05),
+    lambda mix: pxsort.Sorter.create_pseudo_bubble_sorter(project, mix,
+                                                          0.2, 100),
+    lambda mix: pxsort.Sorter.create_pseudo_bubble2_sorter(project, mix,
+                                                           0.2, 100)]
+
+
+def random_pixels(n, seed=0):
+    """
+    Returns n random pixels whose first channels are distinct and lie in
+    distinct sub-intervals of [0, 1] of length 1 / n.
+    """
+    rng = np.random.default_rng(seed)
+    pixels = rng.random((n, DEPTH), dtype='float32')
+    pixels[:, 0] = (rng.permutation(n) + 0.5) / n
+    return pixels
+
+
+def sort_pixels(sorter, pixels):
+    seg_px = pxsort.SegmentPixels(pixels)
+    return np.array(sorter(seg_px, seg_px))
+
+
+def test_bucket_sort_orders_pixels():
+    pixels = random_pixels(1000)
+    sorter = pxsort.Sorter.create_bucket_sorter(project, swap, 1000)
+    result = sort_pixels(sorter, pixels)
+    assert np.array_equal(result, pixels[np.argsort(pixels[:, 0])])
+
+
+def test_sorters_accept_keys_from_projected_image():
+    rng = np.random.default_rng(1)
+    pixels = rng.random((40, 30, DEPTH), dtype='float32')
+    img = pxsort.Image(pixels)
+    keys = img.project(project)
+    assert np.array_equal(np.array(keys)[:, :, 0], pixels[:, :, 0])
+
+    seg = pxsort.Segment([(x, (3 * x) % 30) for x in range(40)])
+    args = (pxsort.SegmentTraversal.Forward, None, pxsort.ImageTopology.Square)
+    seg_px = seg.get_pixels(img, *args)
+    seg_keys = seg.get_pixels(keys, *args)
+
+    sorters = [pxsort.Sorter.create_bucket_sorter(project, swap, 100),
+               pxsort.Sorter.create_bubble_sorter(project, swap, 0.5),
+               pxsort.Sorter.create_pseudo_bubble_sorter(project, swap,
+                                                         0.5, 100)]
+    for sorter in sorters:
+        assert np.array_equal(np.array(sorter(seg_px, seg_px, seg_keys)),
+                              np.array(sorter(seg_px, seg_px)))
+
+
+def test_bucket_sort_is_stable():
+    rng = np.random.default_rng(2)
+    pixels = rng.random((50000, DEPTH), dtype='float32')
+    sorter = pxsort.Sorter.create_bucket_sorter(project, swap, 10)
+    result = sort_pixels(sorter, pixels)
+
+    buckets = np.clip(np.floor(pixels[:, 0].astype('float64') / 0.1), 0, 9)
+    expected = pixels[np.argsort(buckets, kind='stable')]
+    assert np.array_equal(result, expected)
+    assert np.array_equal(sort_pixels(sorter, pixels), result)
+
+
+def test_radix_sort_is_exact_and_stable():
+    rng = np.random.default_rng(4)
+    pixels = rng.random((20000, DEPTH), dtype='float32')
+    # ties, and negative and out-of-range keys
+    pixels[:, 0] = rng.integers(-500, 1500, 20000) / 1000
+    sorter = pxsort.Sorter.create_radix_sorter(project, swap)
+    result = sort_pixels(sorter, pixels)
+    assert np.array_equal(result,
+                          pixels[np.argsort(pixels[:, 0], kind='stable')])
+
+
+def test_heapify_builds_max_heap():
+    pixels = random_pixels(1001, seed=5)
+    sorter = pxsort.Sorter.create_heapify_sorter(project, swap)
+    result = sort_pixels(sorter, pixels)
+
+    keys = result[:, 0]
+    children = np.arange(1, len(keys))
+    assert np.all(keys[(children - 1) // 2] >= keys[children])
+    assert np.array_equal(np.sort(keys), np.sort(pixels[:, 0]))
+
+
+def reference_heapify(pixels):
+    """
+    Serial bottom-up heap construction, ordering pixels by first channel.
+    """
+    result = pixels.copy()
+    n = len(result)
+    for i in range(n // 2 - 1, -1, -1):
+        root = i
+        while True:
+            left, right = 2 * root + 1, 2 * root + 2
+            key = lambda j: result[j, 0] if j < n else -np.inf
+            if key(root) > key(left):
+                largest = root if key(root) > key(right) else right
+            else:
+                largest = left if key(left) > key(right) else right
+            if largest == root:
+                break
+            result[[root, largest]] = result[[largest, root]]
+            root = largest
+    return result
+
+
+def test_heapify_matches_serial_construction():
+    rng = np.random.default_rng(6)
+    pixels = rng.random((5000, DEPTH), dtype='float32')
+    pixels[:, 0] = rng.integers(0, 100, 5000) / 100
+    sorter = pxsort.Sorter.create_heapify_sorter(project, swap)
+    assert np.array_equal(sort_pixels(sorter, pixels),
+                          reference_heapify(pixels))
+
+
+def test_odd_even_bubble():
+    pixels = random_pixels(3000, seed=7)
+    full = pxsort.Sorter.create_odd_even_bubble_sorter(project, swap, 1.0)
+    assert np.array_equal(sort_pixels(full, pixels),
+                          pixels[np.argsort(pixels[:, 0])])
+
+    expected = pixels.copy()
+    for phase in range(300):
+        lo = np.arange(phase % 2, len(expected) - 1, 2)
+        out_of_order = lo[expected[lo + 1, 0] < expected[lo, 0]]
+        expected[np.r_[out_of_order, out_of_order + 1]] = \
+            expected[np.r_[out_of_order + 1, out_of_order]]
+    partial = pxsort.Sorter.create_odd_even_bubble_sorter(project, swap, 0.1)
+    assert np.array_equal(sort_pixels(partial, pixels), expected)
+
+
+@cfunc(pxsort.map_function_signature())
+def copy_values(a_in, m, a_out, n):
+    in_array = carray(a_in, (m,))
+    out_array = carray(a_out, (n,))
+    for i in range(n):
+        out_array[i] = in_array[i]
+
+
+def test_bubble_with_swap_mixer_matches_passes():
+    rng = np.random.default_rng(8)
+    pixels = rng.random((2000, DEPTH), dtype='float32')
+    pixels[:, 0] = rng.integers(0, 200, 2000) / 200
+    opaque = pxsort.Map(copy_values.address, 2 * DEPTH, 2 * DEPTH)
+
+    for channels in [[0, 1, 2], [0, 2]]:
+        mixer = pxsort.Map.swap(channels, DEPTH)
+        assert mixer.selection is not None
+        assert (opaque << mixer).selection is None
+        for fraction in [0.0, 0.01, 0.2, 1.0]:
+            emulated = pxsort.Sorter.create_bubble_sorter(project, mixer,
+                                                          fraction)
+            passes = pxsort.Sorter.create_bubble_sorter(
+                project, opaque << mixer, fraction)
+            assert np.array_equal(sort_pixels(emulated, pixels),
+                                  sort_pixels(passes, pixels))
+
+
+def test_permutation_matches_sorting_with_swap_mixer():
+    rng = np.random.default_rng(9)
+    pixels = rng.random((3000, DEPTH), dtype='float32')
+    pixels[:, 0] = rng.integers(0, 300, 3000) / 300
+    seg_px = pxsort.SegmentPixels(pixels)
+    layer = rng.random((3000, 16), dtype='float32')
+
+    for create in SORTER_FACTORIES:
+        sorter = create(swap)
+        perm = np.array(sorter.permutation(seg_px, seg_px))
+        assert np.array_equal(np.sort(perm), np.arange(3000))
+        assert np.array_equal(pixels[perm], sort_pixels(sorter, pixels))
+
+        permuted = pxsort.Sorter.apply_permutation(
+            pxsort.SegmentPixels(layer), perm)
+        assert np.array_equal(np.array(permuted), layer[perm])
+
+    with pytest.raises(ValueError):
+        pxsort.Sorter.apply_permutation(seg_px, perm[:-1])
+    with pytest.raises(ValueError):
+        pxsort.Sorter.apply_permutation(seg_px, np.append(perm[1:], 3000))
+    with pytest.raises(ValueError):
+        pxsort.Sorter.apply_permutation(seg_px, np.append(perm[1:], perm[1]))
+
+
+def test_selection_mixers_match_opaque_mixers():
+    rng = np.random.default_rng(10)
+    pixels = rng.random((3000, DEPTH), dtype='float32')
+    opaque = pxsort.Map(copy_values.address, 2 * DEPTH, 2 * DEPTH)
+    mixers = [pxsort.Map.swap([0, 1, 2], DEPTH),
+              pxsort.Map.swap([1], DEPTH),
+              pxsort.Map.select([3, 0, 2, 1, 4, 5], 2 * DEPTH)]
+    for mixer in mixers:
+        for create in SORTER_FACTORIES:
+            assert np.array_equal(
+                sort_pixels(create(mixer), pixels),
+                sort_pixels(create(opaque << mixer), pixels))
+
+
+def test_sort_into_matches_sorting_into_a_copy():
+    rng = np.random.default_rng(11)
+    base = rng.random((3000, DEPTH), dtype='float32')
+    skewed = rng.random((3000, DEPTH), dtype='float32')
+    # partial_swap has each Sorter's channel-selection path read the skewed
+    # pixels while writing the result
+    partial_swap = pxsort.Map.swap([1], DEPTH)
+    sorters = [create(mix) for create in SORTER_FACTORIES
+               for mix in [swap, partial_swap]]
+    out = pxsort.SegmentPixels(np.zeros_like(base))
+    for sorter in sorters:
+        base_px = pxsort.SegmentPixels(base)
+        skew_px = pxsort.SegmentPixels(skewed)
+        expected = np.array(sorter(base_px, skew_px))
+
+        # a reused buffer
+        sorter.sort_into(base_px, skew_px, out)
+        assert np.array_equal(np.array(out), expected)
+
+        # in place, into either of the inputs
+        sorter.sort_into(base_px, skew_px, base_px)
+        assert np.array_equal(np.array(base_px), expected)
+        base_px = pxsort.SegmentPixels(base)
+        sorter.sort_into(base_px, skew_px, skew_px)
+        assert np.array_equal(np.array(skew_px), expected)
+
+
+def test_quantile_bucket_sort_spreads_narrow_keys():
+    rng = np.random.default_rng(12)
+    pixels = rng.random((1000, DEPTH), dtype='float32')
+    # every key falls in the first of 1000 equal-width buckets
+    pixels[:, 0] = rng.permutation(1000) / 1e6
+    quantile = pxsort.Sorter.create_quantile_bucket_sorter(project, swap,
+                                                           1000)
+    uniform = pxsort.Sorter.create_bucket_sorter(project, swap, 1000)
+
+    # with as many buckets as pixels, each pixel has a bucket of its own
+    assert np.array_equal(sort_pixels(quantile, pixels),
+                          pixels[np.argsort(pixels[:, 0])])
+    assert np.array_equal(sort_pixels(uniform, pixels), pixels)
+
+
+def test_windowed_sort_bounds_displacement():
+    rng = np.random.default_rng(13)
+    pixels = rng.random((5000, DEPTH), dtype='float32')
+    seg_px = pxsort.SegmentPixels(pixels)
+    for radius in [0, 1, 2, 7, 32]:
+        sorter = pxsort.Sorter.create_windowed_sorter(project, swap, radius)
+        perm = np.array(sorter.permutation(seg_px, seg_px))
+        assert np.array_equal(np.sort(perm), np.arange(5000))
+        assert np.max(np.abs(perm - np.arange(5000))) <= radius
+
+    # pixels are nearly sorted
+    keys = np.array(sort_pixels(sorter, pixels))[:, 0]
+    assert np.mean(keys[1:] >= keys[:-1]) > 0.9
+
+
+def test_partial_sort_sorts_exactly_the_largest_pixels():
+    rng = np.random.default_rng(14)
+    pixels = rng.random((5000, DEPTH), dtype='float32')
+    # ties at the threshold
+    pixels[:, 0] = rng.integers(0, 500, 5000) / 500
+    for fraction in [0.0, 0.013, 0.5, 1.0]:
+        sorter = pxsort.Sorter.create_partial_sorter(project, swap, fraction)
+        n_selected = int(np.ceil(5000 * fraction))
+        order = np.argsort(pixels[:, 0], kind='stable')
+        selected = order[5000 - n_selected:]
+        rest = np.setdiff1d(np.arange(5000), selected)
+        expected = pixels[np.concatenate([rest, selected])]
+        assert np.array_equal(sort_pixels(sorter, pixels), expected)
+
+
+def test_merge_sort():
+    rng = np.random.default_rng(15)
+    pixels = rng.random((3000, DEPTH), dtype='float32')
+    pixels[:, 0] = rng.integers(0, 300, 3000) / 300
+    order = np.argsort(pixels[:, 0], kind='stable')
+    full = pxsort.Sorter.create_merge_sorter(project, swap, -1)
+    assert np.array_equal(sort_pixels(full, pixels), pixels[order])
+
+    # runs of 2^levels pixels are sorted
+    partial = sort_pixels(pxsort.Sorter.create_merge_sorter(project, swap, 3),
+                          pixels)
+    for lo in range(0, 3000, 8):
+        run = pixels[lo:lo + 8]
+        assert np.array_equal(partial[lo:lo + 8],
+                              run[np.argsort(run[:, 0], kind='stable')])
+
+
+def test_short_segments_are_sorted_exactly():
+    rng = np.random.default_rng(16)
+    radix = pxsort.Sorter.create_radix_sorter(project, swap)
+    # with a fraction of 1, every bucket is sorted
+    bucketed = [pxsort.Sorter.create_bucket_sorter(project, swap, 10),
+                pxsort.Sorter.create_pseudo_bubble_sorter(project, swap,
+                                                          1.0, 10)]
+    for n in [1, 2, 3, 17, 64, 100, 128, 129]:
+        pixels = rng.random((n, DEPTH), dtype='float32')
+        # ties, and negative keys
+        pixels[:, 0] = rng.integers(-5, 5, n) / 4
+        order = np.argsort(pixels[:, 0], kind='stable')
+        assert np.array_equal(sort_pixels(radix, pixels), pixels[order])
+
+        # ties, with keys at the centres of buckets
+        pixels[:, 0] = (rng.integers(0, 10, n) + 0.5) / 10
+        order = np.argsort(pixels[:, 0], kind='stable')
+        for sorter in bucketed:
+            assert np.array_equal(sort_pixels(sorter, pixels), pixels[order])
+
+
+def test_pseudo_bubble2_only_moves_selected_pixels():
+    rng = np.random.default_rng(17)
+    n, n_buckets, fraction = 3000, 100, 0.05
+    base = rng.random((n, DEPTH), dtype='float32')
+    skewed = rng.random((n, DEPTH), dtype='float32')
+    # keys lie at the centres of buckets
+    buckets = rng.integers(0, n_buckets, n)
+    skewed[:, 0] = (buckets + 0.5) / n_buckets
+    sorter = pxsort.Sorter.create_pseudo_bubble2_sorter(project, swap,
+                                                        fraction, n_buckets)
+    result = np.array(sorter(pxsort.SegmentPixels(base),
+                             pxsort.SegmentPixels(skewed)))
+
+    # the largest buckets that together hold at most fraction * n pixels
+    target = int(np.ceil(n * fraction))
+    counts = np.bincount(buckets, minlength=n_buckets)
+    min_bucket, size = n_buckets, 0
+    while (min_bucket > 0 and size < target
+           and size + counts[min_bucket - 1] <= target):
+        min_bucket -= 1
+        size += counts[min_bucket]
+
+    # those pixels and the endcap are bucket-sorted among their own
+    # positions, and all other pixels keep their base values
+    selected = (buckets >= min_bucket) | (np.arange(n) >= n - target)
+    idx = np.flatnonzero(selected)
+    expected = base.copy()
+    expected[idx] = skewed[idx][np.argsort(buckets[idx], kind='stable')]
+    assert 0 < len(idx) < n
+    assert np.array_equal(result, expected)